@@ -25,10 +25,13 @@
 #include <QMessageBox>
 #include <QGridLayout>
 #include <QApplication>
+#include <QFileInfo>
 #include <QtMath>
 #include <QDebug>
+#include <QtConcurrent>
 
 #include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -56,17 +59,36 @@ ft::ChildWindow::ChildWindow(QWidget *pParent) :
 	connect(m_pFaceWidget, SIGNAL(onScaleFactorChanged(const double)), this, SLOT(onScaleFactorChanged(const double)));
 	connect(m_pFaceWidget, SIGNAL(onFaceFeaturesSelectionChanged()), this, SLOT(onFaceFeaturesSelectionChanged()));
 	connect(m_pFaceWidget, SIGNAL(onFaceFeaturesChanged()), this, SLOT(onDataChanged()));
-	connect(m_pFaceDatasetModel, SIGNAL(dataChanged(const QModelIndex&, const QModelIndex&, const QVector<int>&)), this, SLOT(onDataChanged()));
+	connect(m_pFaceDatasetModel, SIGNAL(dataChanged(const QModelIndex&, const QModelIndex&, const QVector<int>&)), this, SLOT(onModelDataChanged(const QModelIndex&, const QModelIndex&, const QVector<int>&)));
 	connect(m_pFaceSelectionModel, SIGNAL(currentChanged(const QModelIndex &, const QModelIndex &)), this, SLOT(onCurrentChanged(const QModelIndex &, const QModelIndex &)));
+	connect(&m_oSaveWatcher, SIGNAL(finished()), this, SLOT(onSaveWritten()));
+	connect(&m_oSaveTimer, SIGNAL(timeout()), this, SLOT(onSaveProgress()));
+	connect(m_pFaceDatasetModel, SIGNAL(rowsInserted(const QModelIndex&, int, int)), this, SLOT(onImagesChanged()));
+	connect(m_pFaceDatasetModel, SIGNAL(rowsRemoved(const QModelIndex&, int, int)), this, SLOT(onImagesChanged()));
+	connect(m_pFaceDatasetModel, SIGNAL(modelReset()), this, SLOT(onImagesChanged()));
 
 	// Indicate that it is a brand new dataset (i.e. not yet saved to a file)
 	setProperty("new", true);
 	m_iCurrentImage = -1;
+
+	m_pSaveSnapshot = NULL;
+	m_iEditRevision = 0;
+	m_iSaveRevision = 0;
+	m_iSaveJournalPos = 0;
+	m_oSaveTimer.setInterval(200);
 }
 
 // +-----------------------------------------------------------
 ft::ChildWindow::~ChildWindow()
 {
+	// A snapshot written while the window is closed is never committed, so its
+	// temporary file is discarded and the dataset file is left as it was
+	m_oSaveWatcher.waitForFinished();
+	delete m_pSaveSnapshot;
+
+	// The edits are no longer needed once the window is closed
+	m_oJournal.close();
+
 	delete m_pFaceSelectionModel;
 	delete m_pFaceDatasetModel;
 }
@@ -86,9 +108,12 @@ QItemSelectionModel* ft::ChildWindow::selectionModel() const
 // +-----------------------------------------------------------
 bool ft::ChildWindow::save(QString &sMsgError)
 {
+	waitForSave();
 	if(!m_pFaceDatasetModel->saveToFile(windowFilePath(), sMsgError))
 		return false;
 
+	m_oJournal.close();
+
 	onDataChanged(false);
 	setProperty("new", QVariant()); // No longer a new dataset
 	return true;
@@ -97,9 +122,12 @@ bool ft::ChildWindow::save(QString &sMsgError)
 // +-----------------------------------------------------------
 bool ft::ChildWindow::saveToFile(const QString &sFileName, QString &sMsgError)
 {
+	waitForSave();
 	if(!m_pFaceDatasetModel->saveToFile(sFileName, sMsgError))
 		return false;
 
+	m_oJournal.close();
+
 	setWindowFilePath(sFileName);
 	onDataChanged(false);
 	setProperty("new", QVariant()); // No longer a new dataset
@@ -107,17 +135,128 @@ bool ft::ChildWindow::saveToFile(const QString &sFileName, QString &sMsgError)
 }
 
 // +-----------------------------------------------------------
-bool ft::ChildWindow::loadFromFile(const QString &sFileName, QString &sMsgError)
+void ft::ChildWindow::saveInBackground(const QString &sFileName)
+{
+	if(isSaving())
+		return;
+
+	if(FaceDataset::isBinaryFile(sFileName))
+	{
+		QString sMsgError;
+		bool bRet = saveToFile(sFileName, sMsgError);
+		emit onSaveFinished(bRet, sMsgError);
+		return;
+	}
+
+	// The feature positions are saved as they are right now, even if the
+	// editing continues while the file is written
+	updateFeaturesInDataset();
+	journalEdits();
+	m_pSaveSnapshot = m_pFaceDatasetModel->getFaceDataset()->createSnapshot(sFileName);
+	m_iSaveRevision = m_iEditRevision;
+	m_iSaveJournalPos = m_oJournal.position();
+
+	m_oSaveWatcher.setFuture(QtConcurrent::run(m_pSaveSnapshot, &FaceDatasetSnapshot::write));
+	m_oSaveTimer.start();
+	onSaveProgress();
+	emit onDataModified();
+}
+
+// +-----------------------------------------------------------
+bool ft::ChildWindow::isSaving() const
+{
+	return m_pSaveSnapshot != NULL;
+}
+
+// +-----------------------------------------------------------
+void ft::ChildWindow::waitForSave()
+{
+	if(!isSaving())
+		return;
+
+	m_oSaveWatcher.waitForFinished();
+	onSaveWritten();
+}
+
+// +-----------------------------------------------------------
+void ft::ChildWindow::onSaveProgress()
 {
-	if(!m_pFaceDatasetModel->loadFromFile(qPrintable(sFileName), sMsgError))
+	if(isSaving())
+		FtApplication::showStatusMessage(tr("Saving the face annotation dataset [%1]... %2%").arg(QFileInfo(m_pSaveSnapshot->fileName()).baseName()).arg(m_pSaveSnapshot->progress()), 0);
+}
+
+// +-----------------------------------------------------------
+void ft::ChildWindow::onSaveWritten()
+{
+	// Also called by waitForSave, before the queued signal of the watcher
+	if(!isSaving())
+		return;
+
+	m_oSaveTimer.stop();
+	FaceDatasetSnapshot *pSnapshot = m_pSaveSnapshot;
+	m_pSaveSnapshot = NULL;
+
+	QString sMsgError;
+	QString sFileName = pSnapshot->fileName();
+	bool bRet = m_pFaceDatasetModel->getFaceDataset()->commitSnapshot(pSnapshot, sMsgError);
+	delete pSnapshot;
+
+	if(bRet)
+	{
+		setWindowFilePath(sFileName);
+		setProperty("new", QVariant()); // No longer a new dataset
+		FtApplication::showStatusMessage(tr("The face annotation dataset [%1] was saved.").arg(QFileInfo(sFileName).baseName()));
+
+		// Edits done while the file was written are still pending (and
+		// remain in the journal, now relative to the saved file)
+		if(m_iEditRevision == m_iSaveRevision)
+		{
+			setWindowModified(false);
+			m_oJournal.close();
+		}
+		else if(m_oJournal.isOpen())
+			m_oJournal.open(sFileName, m_iSaveJournalPos);
+	}
+	else
+		FtApplication::showStatusMessage("");
+
+	emit onDataModified();
+	emit onSaveFinished(bRet, sMsgError);
+}
+
+// +-----------------------------------------------------------
+bool ft::ChildWindow::loadFromFile(const QString &sFileName, QString &sMsgError, bool bLazy)
+{
+	if(!m_pFaceDatasetModel->loadFromFile(qPrintable(sFileName), sMsgError, bLazy))
 		return false;
 
+	// The reset of the model by the loading is not an edit to journal
+	m_oJournal.close();
+
 	setWindowFilePath(sFileName);
 	onDataChanged(false);
 	setProperty("new", QVariant()); // No longer a new dataset
 	return true;
 }
 
+// +-----------------------------------------------------------
+bool ft::ChildWindow::recoverEdits(QString &sMsgError)
+{
+	int iNumEdits;
+	if(!EditJournal::replay(windowFilePath(), m_pFaceDatasetModel->getFaceDataset(), iNumEdits, sMsgError))
+		return false;
+
+	// The journal continues with the recovered edits, so they are
+	// not lost if the application is interrupted again
+	m_oJournal.open(windowFilePath(), 0);
+	m_iEditRevision++;
+	setWindowModified(true);
+	emit onDataModified();
+
+	FtApplication::showStatusMessage(tr("%1 edits were recovered in the face annotation dataset [%2].").arg(iNumEdits).arg(QFileInfo(windowFilePath()).baseName()));
+	return true;
+}
+
 // +-----------------------------------------------------------
 void ft::ChildWindow::setZoomLevel(const int iLevel)
 {
@@ -187,11 +326,28 @@ void ft::ChildWindow::onScaleFactorChanged(const double dScaleFactor)
 void ft::ChildWindow::onDataChanged(const bool bModified)
 {
 	if(bModified)
+	{
 		updateFeaturesInDataset();
+		journalEdits();
+		m_iEditRevision++;
+	}
 	setWindowModified(bModified);
 	emit onDataModified();
 }
 
+// +-----------------------------------------------------------
+void ft::ChildWindow::onModelDataChanged(const QModelIndex &oTopLeft, const QModelIndex &oBottomRight, const QVector<int> &vRoles)
+{
+	Q_UNUSED(oTopLeft);
+	Q_UNUSED(oBottomRight);
+
+	// The thumbnails are updated as they are built, which is not a change in the dataset
+	if(vRoles.size() == 1 && vRoles.first() == Qt::DecorationRole)
+		return;
+
+	onDataChanged();
+}
+
 // +-----------------------------------------------------------
 void ft::ChildWindow::onCurrentChanged(const QModelIndex &oCurrent, const QModelIndex &oPrevious)
 {
@@ -222,42 +378,77 @@ void ft::ChildWindow::onCurrentChanged(const QModelIndex &oCurrent, const QModel
 // +-----------------------------------------------------------
 void ft::ChildWindow::refreshFeaturesInWidget()
 {
-	vector<FaceFeature*> vFeats = m_pFaceDatasetModel->getFeatures(m_iCurrentImage);
-	QList<FaceFeatureNode*> lsNodes = m_pFaceWidget->getFaceFeatures(m_pFaceDatasetModel->numFeatures()); // This call automatically guarantees that there are "m_pFaceDatasetModel->numFeatures()" features in the editor
-	for(int i = 0; i < (int) vFeats.size(); i++)
+	// The positions and the connections (the same in all images) are given to the
+	// editor in a single call, directly from the dataset
+	FaceDataset::Shape oShape;
+	if(!m_pFaceDatasetModel->getShape(m_iCurrentImage, oShape) && m_iCurrentImage >= 0)
 	{
-		lsNodes[i]->setData(0, true); // Indication to avoid emitting position change event
+		QString sMsgError;
+		m_pFaceDatasetModel->getFaceDataset()->getImage(m_iCurrentImage, sMsgError);
+		FtApplication::showStatusMessage(tr("The facial landmarks of this image can not be edited: %1").arg(sMsgError), 0);
+	}
+	m_pFaceWidget->setFaceFeatures(oShape.pX, oShape.pY, oShape.iNumFeatures, *oShape.pConnections);
+}
 
-		// Refresh the feature visual in the widget:
-		//    - (re)position the feature
-		//    - (re)do any connections
-		lsNodes[i]->setPos(vFeats[i]->x(), vFeats[i]->y());
-		foreach(int iID, vFeats[i]->getConnections())
-			m_pFaceWidget->connectFaceFeatures(vFeats[i]->getID(), iID);
+// +-----------------------------------------------------------
+bool ft::ChildWindow::loadAllImages()
+{
+	// The features of all images change together, so they must all be read
+	QString sMsgError;
+	if(m_pFaceDatasetModel->getFaceDataset()->loadAllSamples(sMsgError))
+		return true;
 
-		lsNodes[i]->setData(0, false);
-	}
+	QMessageBox::warning(this, tr("Fail to change the facial landmarks"), tr("The facial landmarks can not be added or removed, because the face annotation dataset could not be completely read:\n%1").arg(sMsgError), QMessageBox::Ok);
+	return false;
 }
 
 // +-----------------------------------------------------------
 void ft::ChildWindow::updateFeaturesInDataset()
 {
-	QList<FaceFeatureNode*> lsNodes = m_pFaceWidget->getFaceFeatures();
-	vector<FaceFeature*> vFeats = m_pFaceDatasetModel->getFeatures(m_iCurrentImage);
+	const QList<FaceFeatureNode*> &lsNodes = m_pFaceWidget->getFaceFeatures();
+	FaceImage *pImage = m_pFaceDatasetModel->getFaceDataset()->getImage(m_iCurrentImage);
+	if(!pImage)
+		return;
 
+	// The coordinates are stored in single precision (or in fixed-point, in the
+	// compact mode), so the nodes are compared with them in the same precision
 	FaceFeatureNode* pNode;
-	for(int i = 0; i < (int) vFeats.size(); i++)
+	for(int i = 0; i < pImage->numFeatures(); i++)
 	{
-		if(i >= lsNodes.size()) // Sanity check (vFeats and lsNodes are supposed to have the same size, but who knows?)
+		if(i >= lsNodes.size()) // Sanity check (the image features and lsNodes are supposed to have the same size, but who knows?)
 		{
 			qCritical() << tr("An update of face features in dataset was not performed due to inconsistences.");
 			continue;
 		}
 		pNode = lsNodes.at(i);
-		vFeats[i]->setID(pNode->getID());
-		vFeats[i]->setX(pNode->x());
-		vFeats[i]->setY(pNode->y());
+		if(!pImage->isAt(i, pNode->x(), pNode->y()))
+		{
+			// Also marks the image as changed, so it is written in the next save
+			pImage->moveFeature(i, pNode->x(), pNode->y());
+			m_oJournal.moveFeature(m_iCurrentImage, i, pNode->getID(), pNode->pos());
+		}
+	}
+}
+
+// +-----------------------------------------------------------
+void ft::ChildWindow::journalEdits()
+{
+	// There is no file to which the edits of a new dataset could be applied
+	if(property("new").toBool())
+	{
+		m_oJournal.discard();
+		return;
 	}
+
+	if(!m_oJournal.isOpen())
+		m_oJournal.open(windowFilePath());
+	m_oJournal.flush();
+}
+
+// +-----------------------------------------------------------
+void ft::ChildWindow::onImagesChanged()
+{
+	m_oJournal.interrupt();
 }
 
 // +-----------------------------------------------------------
@@ -328,32 +519,96 @@ void ft::ChildWindow::setContextMenu(QMenu *pMenu)
 // +-----------------------------------------------------------
 void ft::ChildWindow::addFeature(const QPointF &oPos)
 {
+	if(isSaving() || !loadAllImages())
+		return;
+
 	FaceFeatureNode *pNode = m_pFaceWidget->addFaceFeature(oPos, true);
-	m_pFaceDatasetModel->addFeature(pNode->getID(), pNode->x(), pNode->y());
+	m_pFaceDatasetModel->addFeature(pNode->x(), pNode->y());
+	m_oJournal.addFeature(pNode->getID(), pNode->pos());
+	onDataChanged();
+}
+
+// +-----------------------------------------------------------
+void ft::ChildWindow::addImages(const QStringList &lImageFiles)
+{
+	if(isSaving())
+		return;
+
+	m_pFaceDatasetModel->addImages(lImageFiles);
+	onDataChanged();
+}
+
+// +-----------------------------------------------------------
+void ft::ChildWindow::setCompactCoordinates(bool bCompact)
+{
+	FaceDataset *pDataset = m_pFaceDatasetModel->getFaceDataset();
+	if(isSaving() || bCompact == pDataset->isCompactCoordinates())
+		return;
+
+	// All the coordinates are converted, so the whole dataset must be saved again
+	pDataset->setCompactCoordinates(bCompact);
+	onDataChanged();
+}
+
+// +-----------------------------------------------------------
+void ft::ChildWindow::removeImages(const QList<int> &lImageIndexes)
+{
+	if(lImageIndexes.isEmpty())
+		return;
+
+	// The changes in the image on display are stored while its row is still valid
+	updateFeaturesInDataset();
+	journalEdits();
+
+	bool bHadCurrent = m_pFaceSelectionModel->currentIndex().isValid();
+	int iFirst = *std::min_element(lImageIndexes.begin(), lImageIndexes.end());
+	m_pFaceDatasetModel->removeImages(lImageIndexes);
+
+	// The rows before the current image shift it without notifying it, and the reset
+	// of the model (if the rows are too scattered) clears the current index
+	QModelIndex oCurrent = m_pFaceSelectionModel->currentIndex();
+	if(oCurrent.isValid())
+		m_iCurrentImage = oCurrent.row();
+	else if(bHadCurrent && m_pFaceDatasetModel->rowCount() > 0)
+		m_pFaceSelectionModel->setCurrentIndex(m_pFaceDatasetModel->index(qMin(iFirst, m_pFaceDatasetModel->rowCount() - 1), 0), QItemSelectionModel::ClearAndSelect);
+	else
+		onCurrentChanged(QModelIndex(), QModelIndex());
+
 	onDataChanged();
 }
 
 // +-----------------------------------------------------------
 void ft::ChildWindow::removeSelectedFeatures()
 {
-	bool bUpdated = false;
+	if(isSaving())
+		return;
+
 	QList<FaceFeatureNode*> lsFeats = m_pFaceWidget->getSelectedFeatures();
+	if(lsFeats.isEmpty() || !loadAllImages())
+		return;
+
+	vector<int> vIndexes;
 	foreach(FaceFeatureNode *pNode, lsFeats)
-	{
-		m_pFaceDatasetModel->removeFeature(pNode->getID());
-		m_pFaceWidget->removeFaceFeature(pNode);
-		bUpdated = true;
-	}
-	if(bUpdated)
-	{
-		updateFeaturesInDataset();
-		onDataChanged();
-	}
+		vIndexes.push_back(pNode->getID());
+	sort(vIndexes.begin(), vIndexes.end());
+
+	// All the features are removed at once; the journal records them from the last
+	// one, so each record still refers to the same feature when it is replayed
+	m_pFaceDatasetModel->removeFeatures(vIndexes);
+	for(int i = (int) vIndexes.size() - 1; i >= 0; i--)
+		m_oJournal.removeFeature(vIndexes[i]);
+	m_pFaceWidget->removeFaceFeatures(lsFeats);
+
+	updateFeaturesInDataset();
+	onDataChanged();
 }
 
 // +-----------------------------------------------------------
 void ft::ChildWindow::connectFeatures()
 {
+	if(isSaving())
+		return;
+
 	bool bUpdated = false;
 	QList<FaceFeatureNode*> lsFeats = m_pFaceWidget->getSelectedFeatures();
 	QList<FaceFeatureNode*>::iterator oFirst, oSecond;
@@ -364,6 +619,7 @@ void ft::ChildWindow::connectFeatures()
 		{
 			m_pFaceWidget->connectFaceFeatures(*oFirst, *oSecond);
 			m_pFaceDatasetModel->connectFeatures((*oFirst)->getID(), (*oSecond)->getID());
+			m_oJournal.connectFeatures((*oFirst)->getID(), (*oSecond)->getID());
 			bUpdated = true;
 		}
 	}
@@ -374,6 +630,9 @@ void ft::ChildWindow::connectFeatures()
 // +-----------------------------------------------------------
 void ft::ChildWindow::connectFeatures(const std::vector<std::pair<int, int>>& feature_idx_pairs)
 {
+	if(isSaving())
+		return;
+
 	if (feature_idx_pairs.empty())
 		return;
 
@@ -381,6 +640,7 @@ void ft::ChildWindow::connectFeatures(const std::vector<std::pair<int, int>>& fe
 	for each (const std::pair<int, int> &p in feature_idx_pairs)
 	{
 		m_pFaceDatasetModel->connectFeatures(p.first, p.second);
+		m_oJournal.connectFeatures(p.first, p.second);
 		m_pFaceWidget->connectFaceFeatures(p.first, p.second);
 	}
 	onDataChanged();
@@ -389,6 +649,9 @@ void ft::ChildWindow::connectFeatures(const std::vector<std::pair<int, int>>& fe
 // +-----------------------------------------------------------
 void ft::ChildWindow::disconnectFeatures()
 {
+	if(isSaving())
+		return;
+
 	bool bUpdated = false;
 	QList<FaceFeatureNode*> lsFeats = m_pFaceWidget->getSelectedFeatures();
 	QList<FaceFeatureNode*>::iterator oFirst, oSecond;
@@ -399,6 +662,7 @@ void ft::ChildWindow::disconnectFeatures()
 		{
 			m_pFaceWidget->disconnectFaceFeatures(*oFirst, *oSecond);
 			m_pFaceDatasetModel->disconnectFeatures((*oFirst)->getID(), (*oSecond)->getID());
+			m_oJournal.disconnectFeatures((*oFirst)->getID(), (*oSecond)->getID());
 			bUpdated = true;
 		}
 	}
@@ -409,24 +673,39 @@ void ft::ChildWindow::disconnectFeatures()
 // +-----------------------------------------------------------
 bool ft::ChildWindow::positionFeatures(const std::vector<QPointF> &vPoints)
 {
+	// The number of features can not change while the dataset is saved
+	if(isSaving() && vPoints.size() != (size_t) m_pFaceDatasetModel->numFeatures())
+		return false;
+	if(vPoints.size() != (size_t) m_pFaceDatasetModel->numFeatures() && !loadAllImages())
+		return false;
+
 	QList<FaceFeatureNode *> lFeats = m_pFaceWidget->getFaceFeatures(vPoints.size()); // this call automatically adds or removes features to match vPoints.size()
 	
 	// Adjust the dataset so it has the same amount of features as the widget
-	vector<FaceFeature*> vFeats = m_pFaceDatasetModel->getFeatures(m_iCurrentImage);
-	int iDiff = lFeats.size() - vFeats.size();
+	int iDiff = lFeats.size() - m_pFaceDatasetModel->numFeatures();
 
 	// If the widget has more features than the dataset, add the difference
 	if (iDiff > 0)
 	{
+		// The new features are journaled with the IDs they get in the dataset
+		int iOldCount = m_pFaceDatasetModel->numFeatures();
 		for (int i = 0; i < iDiff; i++)
-			m_pFaceDatasetModel->addFeature(lFeats.size() + i - 1, 0, 0);
+		{
+			m_pFaceDatasetModel->addFeature(0, 0);
+			m_oJournal.addFeature(iOldCount + i, QPointF(0, 0));
+		}
 	}
 
 	// Else, if the widget has less features than the dataset, remove the difference
 	else if (iDiff < 0)
 	{
-		for (int i = 0; i < abs(iDiff); i++)
-			m_pFaceDatasetModel->removeFeature(lFeats.size() - i - 1);
+		vector<int> vIndexes;
+		for (int i = lFeats.size(); i < m_pFaceDatasetModel->numFeatures(); i++)
+			vIndexes.push_back(i);
+
+		m_pFaceDatasetModel->removeFeatures(vIndexes);
+		for (int i = (int) vIndexes.size() - 1; i >= 0; i--)
+			m_oJournal.removeFeature(vIndexes[i]);
 	}
 
 	// Move the features
@@ -436,9 +715,7 @@ bool ft::ChildWindow::positionFeatures(const std::vector<QPointF> &vPoints)
 		pFeat = lFeats.at(i);
 		pFeat->setPos(vPoints[i]);
 	}
-	updateFeaturesInDataset();
-	setWindowModified(true);
-	emit onDataModified();
+	onDataChanged();
 
 	return true;
 }
\ No newline at end of file
@@ -23,9 +23,12 @@
 
 #include "facedatasetmodel.h"
 #include "facewidget.h"
+#include "editjournal.h"
 
 #include <QtGui>
 #include <QWidget>
+#include <QTimer>
+#include <QFutureWatcher>
 
 namespace ft
 {
@@ -77,12 +80,44 @@ namespace ft
 		 */
 		bool saveToFile(const QString &sFileName, QString &sMsgError);
 
+		/**
+		 * Starts saving the contents of the face annotation dataset in this window to the given
+		 * file in a background thread, so the dataset can still be edited while it is saved. The
+		 * end of the saving is indicated by the signal onSaveFinished. Binary files are saved
+		 * immediately (the signal is emitted before the method returns).
+		 * @param sFileName QString with the path and name of the file to save the dataset to.
+		 */
+		void saveInBackground(const QString &sFileName);
+
+		/**
+		 * Indicates if the dataset is being saved in background. While it is, images and features
+		 * can not be added nor removed (but the features can still be moved).
+		 * @return Boolean indicating if there is a save in progress.
+		 */
+		bool isSaving() const;
+
+		/**
+		 * Waits for the save in progress (if any) to finish.
+		 */
+		void waitForSave();
+
 		/**
 		 * Loads the contents of the face annotation dataset from the given file into this window.
 		 * The file must be in the YAML format, as defined in the FaceDataset class.
 		 * @param sFileName QString with the path and name of the file to load the dataset from.
+		 * @param bLazy Boolean indicating if the image samples should only be parsed when first
+		 * accessed (true) or all loaded at once (false).
+		 */
+		bool loadFromFile(const QString &sFileName, QString &sMsgError, bool bLazy = false);
+
+		/**
+		 * Recovers the edits done in the face annotation dataset after it was last saved, from
+		 * the journal left by a previous execution that was not properly closed. The dataset
+		 * must have just been loaded from its file.
+		 * @param sMsgError QString to receive the error message in case the method fails.
+		 * @return Boolean indicating if the edits were recovered (true) or not (false).
 		 */
-		bool loadFromFile(const QString &sFileName, QString &sMsgError);
+		bool recoverEdits(QString &sMsgError);
 
 		/**
 		 * Sets the zoom level of the image in display in terms of the steps defined in the zoom
@@ -190,6 +225,25 @@ namespace ft
 		 */
 		void addFeature(const QPointF &oPos);
 
+		/**
+		 * Adds the given images to the dataset (the ones already in it are ignored).
+		 * @param lImageFiles QStringList with the file names of the images to add.
+		 */
+		void addImages(const QStringList &lImageFiles);
+
+		/**
+		 * Changes the storage of the coordinates of all images in the dataset (see
+		 * FaceDataset::setCompactCoordinates), which marks the whole dataset as modified.
+		 * @param bCompact Boolean indicating if the coordinates must be compact (true) or floats (false).
+		 */
+		void setCompactCoordinates(bool bCompact);
+
+		/**
+		 * Removes the given images from the dataset.
+		 * @param lImageIndexes QList with the indexes of the images to remove (in any order).
+		 */
+		void removeImages(const QList<int> &lImageIndexes);
+
 		/**
 		 * Removes the selected features and all their connections.
 		 */
@@ -233,6 +287,19 @@ namespace ft
 		 */
 		void updateFeaturesInDataset();
 
+		/**
+		 * Reads all the images not yet read from the dataset file (opened lazily), before the
+		 * features of all images are changed. The user is warned if any of them can not be read.
+		 * @return Boolean indicating if all the images were read (true) or not (false).
+		 */
+		bool loadAllImages();
+
+		/**
+		 * Writes the edits recorded since the last call to the journal of the dataset (that is
+		 * started on the first edit after the dataset is loaded or saved).
+		 */
+		void journalEdits();
+
 	protected slots:
 
 		/**
@@ -254,11 +321,35 @@ namespace ft
 		 */
 		void onDataChanged(const bool bModified = true);
 
+		/**
+		 * Captures the indication of changes in the data model. The changes of decoration only
+		 * (the thumbnails) are not changes in the dataset, so they are ignored.
+		 * @param oTopLeft QModelIndex with the first index changed.
+		 * @param oBottomRight QModelIndex with the last index changed.
+		 * @param vRoles QVector with the roles of the data changed (empty if all roles changed).
+		 */
+		void onModelDataChanged(const QModelIndex &oTopLeft, const QModelIndex &oBottomRight, const QVector<int> &vRoles);
+
 		/**
 		 * Captures indication of changes in the current selected image on the selection model.
 		 */
 		void onCurrentChanged(const QModelIndex &oCurrent, const QModelIndex &oPrevious);
 
+		/**
+		 * Updates the progress of the save in progress in the status bar.
+		 */
+		void onSaveProgress();
+
+		/**
+		 * Captures the indication that the background thread finished writing the dataset file.
+		 */
+		void onSaveWritten();
+
+		/**
+		 * Captures the indication that images were added to or removed from the dataset.
+		 */
+		void onImagesChanged();
+
 	signals:
 
 		/**
@@ -279,6 +370,13 @@ namespace ft
 		 */
 		void onUIUpdated(const QString sImageName, const int iZoomLevel);
 
+		/**
+		 * Signal to indicate that a save started with saveInBackground finished.
+		 * @param bSuccess Boolean indicating if the saving was successful or not.
+		 * @param sMsgError QString with the error message in case the saving failed.
+		 */
+		void onSaveFinished(const bool bSuccess, const QString sMsgError);
+
 	private:
 
 		/** Index of the current displayed face image. */
@@ -292,6 +390,27 @@ namespace ft
 
 		/** Selection model used to represent the selection of items in Qt view components such as QListView. */
 		QItemSelectionModel *m_pFaceSelectionModel;
+
+		/** Snapshot of the dataset being saved in background (NULL if there is no save in progress). */
+		FaceDatasetSnapshot *m_pSaveSnapshot;
+
+		/** Watcher of the background thread that writes the snapshot. */
+		QFutureWatcher<bool> m_oSaveWatcher;
+
+		/** Timer used to display the progress of the save in progress. */
+		QTimer m_oSaveTimer;
+
+		/** Counter of the edits, used to know if the dataset was edited after the snapshot being saved. */
+		unsigned int m_iEditRevision;
+
+		/** Value of the edits counter when the snapshot being saved was created. */
+		unsigned int m_iSaveRevision;
+
+		/** Journal of the edits done since the dataset was last saved. */
+		EditJournal m_oJournal;
+
+		/** Position of the journal when the snapshot being saved was created. */
+		qint64 m_iSaveJournalPos;
 	};
 }
 
@@ -0,0 +1,376 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "editjournal.h"
+
+#include <QFileInfo>
+#include <QDateTime>
+#include <QApplication>
+
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+	/** Identification of the edit journal files. */
+	const char JOURNAL_MAGIC[4] = { 'F', 'A', 'D', 'J' };
+
+	/** Version of the edit journal format. */
+	const quint32 JOURNAL_VERSION = 1;
+
+	/** Marker used to detect files written in a different byte order. */
+	const quint32 JOURNAL_BYTE_ORDER = 0x01020304;
+
+	/**
+	 * Header of the edit journal files. The version of the dataset file to which the journal
+	 * applies is identified by its size and time of last modification.
+	 */
+	struct JournalHeader
+	{
+		char aMagic[4];
+		quint32 iVersion;
+		quint32 iByteOrder;
+		quint32 iReserved;
+		qint64 iFileSize;
+		qint64 iFileTime;
+	};
+	Q_STATIC_ASSERT(sizeof(JournalHeader) == 32);
+
+	/** Types of the records in the edit journal. */
+	enum RecordType
+	{
+		MoveFeature = 1,
+		AddFeature,
+		RemoveFeature,
+		ConnectFeatures,
+		DisconnectFeatures,
+		Interruption
+	};
+
+	/** Record of one edit in the journal. */
+	struct JournalRecord
+	{
+		quint32 iType;
+		qint32 iImage;
+		qint32 iFeature;
+		qint32 iValue;
+		double dX;
+		double dY;
+	};
+	Q_STATIC_ASSERT(sizeof(JournalRecord) == 32);
+
+	/**
+	 * Fills the journal header for the given dataset file, as it is currently saved.
+	 * @param sDatasetFile QString with the name of the dataset file.
+	 * @param oHeader JournalHeader to fill.
+	 */
+	void makeHeader(const QString &sDatasetFile, JournalHeader &oHeader)
+	{
+		QFileInfo oInfo(sDatasetFile);
+		memset(&oHeader, 0, sizeof(oHeader));
+		memcpy(oHeader.aMagic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+		oHeader.iVersion = JOURNAL_VERSION;
+		oHeader.iByteOrder = JOURNAL_BYTE_ORDER;
+		oHeader.iFileSize = oInfo.size();
+		oHeader.iFileTime = oInfo.lastModified().toMSecsSinceEpoch();
+	}
+
+	/**
+	 * Reads the records of the given journal file (ignoring an incomplete last record,
+	 * that might have been partially written when the application was interrupted).
+	 * @param sJournalFile QString with the name of the journal file.
+	 * @param oHeader JournalHeader to receive the header of the journal.
+	 * @param oRecords QByteArray to receive the records.
+	 * @return Boolean indicating if the journal was read (true) or if it could not be read
+	 * or is not valid (false).
+	 */
+	bool readJournal(const QString &sJournalFile, JournalHeader &oHeader, QByteArray &oRecords)
+	{
+		QFile oFile(sJournalFile);
+		if(!oFile.open(QFile::ReadOnly))
+			return false;
+
+		if(oFile.read((char *) &oHeader, sizeof(oHeader)) != sizeof(oHeader))
+			return false;
+		if(memcmp(oHeader.aMagic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || oHeader.iVersion != JOURNAL_VERSION || oHeader.iByteOrder != JOURNAL_BYTE_ORDER)
+			return false;
+
+		oRecords = oFile.readAll();
+		oRecords.truncate(oRecords.size() - oRecords.size() % sizeof(JournalRecord));
+		return true;
+	}
+
+	/**
+	 * Applies one record of the journal to the given dataset.
+	 * @param oRecord JournalRecord to apply.
+	 * @param pDataset Instance of the FaceDataset to change.
+	 * @return Boolean indicating if the record was applied (true) or if it does not
+	 * match the dataset (false).
+	 */
+	bool applyRecord(const JournalRecord &oRecord, ft::FaceDataset *pDataset)
+	{
+		switch(oRecord.iType)
+		{
+			case MoveFeature:
+			{
+				// The features are identified by their indices, so the ID is not used
+				ft::FaceImage *pImage = pDataset->getImage(oRecord.iImage);
+				return pImage && pImage->moveFeature(oRecord.iFeature, oRecord.dX, oRecord.dY);
+			}
+
+			case AddFeature:
+				pDataset->addFeature(oRecord.dX, oRecord.dY);
+				return true;
+
+			case RemoveFeature:
+				return pDataset->removeFeature(oRecord.iFeature);
+
+			case ConnectFeatures:
+				return pDataset->connectFeatures(oRecord.iFeature, oRecord.iValue);
+
+			case DisconnectFeatures:
+				return pDataset->disconnectFeatures(oRecord.iFeature, oRecord.iValue);
+
+			default:
+				return false;
+		}
+	}
+}
+
+// +-----------------------------------------------------------
+ft::EditJournal::EditJournal()
+{
+	m_pFile = NULL;
+	m_iFlushed = 0;
+	m_bInterrupted = false;
+}
+
+// +-----------------------------------------------------------
+ft::EditJournal::~EditJournal()
+{
+	close(false);
+}
+
+// +-----------------------------------------------------------
+QString ft::EditJournal::journalFileName(const QString &sDatasetFile)
+{
+	return sDatasetFile + ".journal";
+}
+
+// +-----------------------------------------------------------
+bool ft::EditJournal::exists(const QString &sDatasetFile)
+{
+	return QFileInfo(journalFileName(sDatasetFile)).size() >= (qint64) (sizeof(JournalHeader) + sizeof(JournalRecord));
+}
+
+// +-----------------------------------------------------------
+void ft::EditJournal::remove(const QString &sDatasetFile)
+{
+	QFile::remove(journalFileName(sDatasetFile));
+}
+
+// +-----------------------------------------------------------
+bool ft::EditJournal::replay(const QString &sDatasetFile, FaceDataset *pDataset, int &iNumEdits, QString &sMsgError)
+{
+	iNumEdits = 0;
+
+	JournalHeader oHeader, oCurrent;
+	QByteArray oRecords;
+	if(!readJournal(journalFileName(sDatasetFile), oHeader, oRecords))
+	{
+		sMsgError = QString(QApplication::translate("EditJournal", "the journal file [%1] could not be read or is invalid")).arg(journalFileName(sDatasetFile));
+		return false;
+	}
+
+	makeHeader(sDatasetFile, oCurrent);
+	if(oHeader.iFileSize != oCurrent.iFileSize || oHeader.iFileTime != oCurrent.iFileTime)
+	{
+		sMsgError = QString(QApplication::translate("EditJournal", "the file [%1] was changed after the journal was written")).arg(sDatasetFile);
+		return false;
+	}
+
+	const JournalRecord *pRecords = (const JournalRecord *) oRecords.constData();
+	int iCount = oRecords.size() / sizeof(JournalRecord);
+	for(int i = 0; i < iCount; i++)
+	{
+		if(!applyRecord(pRecords[i], pDataset))
+			break;
+		iNumEdits++;
+	}
+
+	return true;
+}
+
+// +-----------------------------------------------------------
+bool ft::EditJournal::open(const QString &sDatasetFile, qint64 iKeepFrom)
+{
+	QString sJournalFile = journalFileName(sDatasetFile);
+
+	/******************************************************
+	 * Get the records to keep, from the current journal
+	 * or from the existing journal of the dataset file
+	 ******************************************************/
+	QByteArray oKept;
+	if(iKeepFrom >= 0)
+	{
+		flush();
+		JournalHeader oHeader;
+		if(readJournal(m_pFile ? m_pFile->fileName() : sJournalFile, oHeader, oKept))
+			oKept = oKept.mid(iKeepFrom * sizeof(JournalRecord));
+	}
+
+	// The edits not yet flushed are kept in any case
+	QByteArray oPending = m_oPending;
+	if(m_pFile && m_pFile->fileName() != sJournalFile)
+		close(true);
+	else
+		close(false);
+	m_oPending = oPending;
+
+	/******************************************************
+	 * Write the new journal
+	 ******************************************************/
+	m_pFile = new QFile(sJournalFile);
+	if(!m_pFile->open(QFile::WriteOnly | QFile::Truncate))
+	{
+		delete m_pFile;
+		m_pFile = NULL;
+		return false;
+	}
+
+	JournalHeader oHeader;
+	makeHeader(sDatasetFile, oHeader);
+	m_pFile->write((const char *) &oHeader, sizeof(oHeader));
+	m_pFile->write(oKept);
+	if(!m_pFile->flush())
+	{
+		close(true);
+		return false;
+	}
+
+	m_iFlushed = oKept.size() / sizeof(JournalRecord);
+	oKept.append(m_oPending);
+	const JournalRecord *pRecords = (const JournalRecord *) oKept.constData();
+	for(int i = 0; i < (int) (oKept.size() / sizeof(JournalRecord)) && !m_bInterrupted; i++)
+		m_bInterrupted = pRecords[i].iType == Interruption;
+
+	return true;
+}
+
+// +-----------------------------------------------------------
+void ft::EditJournal::close(bool bRemove)
+{
+	m_oPending.clear();
+	m_iFlushed = 0;
+	m_bInterrupted = false;
+	if(!m_pFile)
+		return;
+
+	m_pFile->close();
+	if(bRemove)
+		m_pFile->remove();
+	delete m_pFile;
+	m_pFile = NULL;
+}
+
+// +-----------------------------------------------------------
+bool ft::EditJournal::isOpen() const
+{
+	return m_pFile != NULL;
+}
+
+// +-----------------------------------------------------------
+qint64 ft::EditJournal::position() const
+{
+	return m_iFlushed + m_oPending.size() / sizeof(JournalRecord);
+}
+
+// +-----------------------------------------------------------
+bool ft::EditJournal::flush()
+{
+	if(!m_pFile || m_oPending.isEmpty())
+		return true;
+
+	// A single write to the system (not synced to disk, which would
+	// take milliseconds)
+	bool bRet = m_pFile->write(m_oPending) == m_oPending.size() && m_pFile->flush();
+	m_iFlushed += m_oPending.size() / sizeof(JournalRecord);
+	m_oPending.clear();
+	return bRet;
+}
+
+// +-----------------------------------------------------------
+void ft::EditJournal::discard()
+{
+	m_oPending.clear();
+}
+
+// +-----------------------------------------------------------
+void ft::EditJournal::moveFeature(int iImage, int iIndex, int iID, const QPointF &oPos)
+{
+	append(MoveFeature, iImage, iIndex, iID, oPos);
+}
+
+// +-----------------------------------------------------------
+void ft::EditJournal::addFeature(int iID, const QPointF &oPos)
+{
+	append(AddFeature, -1, iID, 0, oPos);
+}
+
+// +-----------------------------------------------------------
+void ft::EditJournal::removeFeature(int iIndex)
+{
+	append(RemoveFeature, -1, iIndex, 0);
+}
+
+// +-----------------------------------------------------------
+void ft::EditJournal::connectFeatures(int iIDSource, int iIDTarget)
+{
+	append(ConnectFeatures, -1, iIDSource, iIDTarget);
+}
+
+// +-----------------------------------------------------------
+void ft::EditJournal::disconnectFeatures(int iIDSource, int iIDTarget)
+{
+	append(DisconnectFeatures, -1, iIDSource, iIDTarget);
+}
+
+// +-----------------------------------------------------------
+void ft::EditJournal::interrupt()
+{
+	append(Interruption, -1, 0, 0);
+	m_bInterrupted = true;
+}
+
+// +-----------------------------------------------------------
+void ft::EditJournal::append(quint32 iType, qint32 iImage, qint32 iFeature, qint32 iValue, const QPointF &oPos)
+{
+	if(m_bInterrupted)
+		return;
+
+	JournalRecord oRecord;
+	oRecord.iType = iType;
+	oRecord.iImage = iImage;
+	oRecord.iFeature = iFeature;
+	oRecord.iValue = iValue;
+	oRecord.dX = oPos.x();
+	oRecord.dY = oPos.y();
+	m_oPending.append((const char *) &oRecord, sizeof(oRecord));
+}
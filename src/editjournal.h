@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include "facedataset.h"
+
+#include <QFile>
+#include <QByteArray>
+
+namespace ft
+{
+	/**
+	 * Append-only journal of the edits done in a face annotation dataset since it was last saved.
+	 * The journal is a binary file next to the dataset file (with the extension .journal added),
+	 * with a small header identifying the version of the dataset file it applies to, followed by
+	 * fixed-size records, one for each change of a face feature. The records are buffered in
+	 * memory and appended to the file with a single write at the end of each edit (flush), so
+	 * journaling costs only microseconds per edit. The file is removed when the dataset is saved
+	 * or closed, so if it exists when the dataset is opened, the application was not properly
+	 * closed and the edits can be recovered by replaying the journal (replay).
+	 */
+	class EditJournal
+	{
+	public:
+		/**
+		 * Class constructor.
+		 */
+		EditJournal();
+
+		/**
+		 * Class destructor. The journal file is kept (it is only removed by close).
+		 */
+		virtual ~EditJournal();
+
+		/**
+		 * Gets the name of the journal file of the given dataset file.
+		 * @param sDatasetFile QString with the name of the dataset file.
+		 * @return QString with the name of the journal file.
+		 */
+		static QString journalFileName(const QString &sDatasetFile);
+
+		/**
+		 * Indicates if there is a journal with edits to recover for the given dataset file.
+		 * @param sDatasetFile QString with the name of the dataset file.
+		 * @return Boolean indicating if the journal exists and has edits (true) or not (false).
+		 */
+		static bool exists(const QString &sDatasetFile);
+
+		/**
+		 * Removes the journal of the given dataset file (if any).
+		 * @param sDatasetFile QString with the name of the dataset file.
+		 */
+		static void remove(const QString &sDatasetFile);
+
+		/**
+		 * Applies to the given dataset the edits in the journal of the given dataset file. The
+		 * dataset must have just been loaded from the file, and the file must not have been
+		 * changed after the journal was started. The replay stops at the first edit that
+		 * can not be applied to the dataset (such as the edits done after images were added
+		 * or removed, which are not journaled).
+		 * @param sDatasetFile QString with the name of the dataset file.
+		 * @param pDataset Instance of the FaceDataset loaded from the file.
+		 * @param iNumEdits Integer to receive the number of edits applied.
+		 * @param sMsgError QString to receive the error message in case the method fails.
+		 * @return Boolean indicating if the replay was successful (true) or failed (false).
+		 */
+		static bool replay(const QString &sDatasetFile, FaceDataset *pDataset, int &iNumEdits, QString &sMsgError);
+
+		/**
+		 * (Re)starts the journal for the given dataset file, as it is currently saved. The
+		 * edits already in the journal from the given position on are kept (all edits are
+		 * discarded by default). If the journal was open for another dataset file, that
+		 * journal is removed.
+		 * @param sDatasetFile QString with the name of the dataset file.
+		 * @param iKeepFrom Position (as returned by position()) of the first edit to keep, or
+		 * -1 to discard all edits.
+		 * @return Boolean indicating if the journal was started (true) or not (false).
+		 */
+		bool open(const QString &sDatasetFile, qint64 iKeepFrom = -1);
+
+		/**
+		 * Closes the journal, discarding the edits not yet flushed.
+		 * @param bRemove Boolean indicating if the journal file should be removed (the default)
+		 * or kept.
+		 */
+		void close(bool bRemove = true);
+
+		/**
+		 * Indicates if the journal is open.
+		 * @return Boolean indicating if the journal is open (true) or not (false).
+		 */
+		bool isOpen() const;
+
+		/**
+		 * Gets the number of edits in the journal (including the ones not yet flushed), that is
+		 * also the position of the next edit.
+		 * @return Integer with the number of edits.
+		 */
+		qint64 position() const;
+
+		/**
+		 * Writes the edits buffered since the last flush to the journal file.
+		 * @return Boolean indicating if the edits were written (true) or not (false).
+		 */
+		bool flush();
+
+		/**
+		 * Discards the edits buffered since the last flush.
+		 */
+		void discard();
+
+		/**
+		 * Records the change of the position (and identifier) of a face feature.
+		 * @param iImage Index of the face image.
+		 * @param iIndex Index of the face feature in the image.
+		 * @param iID Identifier of the face feature.
+		 * @param oPos QPointF with the new position of the face feature.
+		 */
+		void moveFeature(int iImage, int iIndex, int iID, const QPointF &oPos);
+
+		/**
+		 * Records the addition of a face feature (to all images in the dataset).
+		 * @param iID Identifier of the new face feature.
+		 * @param oPos QPointF with the position of the new face feature.
+		 */
+		void addFeature(int iID, const QPointF &oPos);
+
+		/**
+		 * Records the removal of a face feature (from all images in the dataset).
+		 * @param iIndex Index of the face feature removed.
+		 */
+		void removeFeature(int iIndex);
+
+		/**
+		 * Records the connection of two face features.
+		 * @param iIDSource Identifier of the first face feature.
+		 * @param iIDTarget Identifier of the second face feature.
+		 */
+		void connectFeatures(int iIDSource, int iIDTarget);
+
+		/**
+		 * Records the disconnection of two face features.
+		 * @param iIDSource Identifier of the first face feature.
+		 * @param iIDTarget Identifier of the second face feature.
+		 */
+		void disconnectFeatures(int iIDSource, int iIDTarget);
+
+		/**
+		 * Records a change in the dataset that is not journaled (such as the addition or removal
+		 * of images). The edits after it can not be replayed, so nothing else is recorded until
+		 * the journal is restarted.
+		 */
+		void interrupt();
+
+	protected:
+
+		/**
+		 * Buffers a new record in the journal.
+		 * @param iType Type of the edit.
+		 * @param iImage Index of the face image (if the edit applies to a single image).
+		 * @param iFeature First value of the edit (index or identifier of a face feature).
+		 * @param iValue Second value of the edit (identifier of a face feature).
+		 * @param oPos QPointF with the position of the face feature (if any).
+		 */
+		void append(quint32 iType, qint32 iImage, qint32 iFeature, qint32 iValue, const QPointF &oPos = QPointF());
+
+	private:
+
+		/** Journal file (NULL if the journal is not open). */
+		QFile *m_pFile;
+
+		/** Records not yet written to the file. */
+		QByteArray m_oPending;
+
+		/** Number of records in the file. */
+		qint64 m_iFlushed;
+
+		/** Indication if an edit that is not journaled was recorded. */
+		bool m_bInterrupted;
+	};
+}
+
+#endif // EDITJOURNAL_H
@@ -18,203 +18,1761 @@
  */
 
 #include "facedataset.h"
+#include "gzipdevice.h"
 
 #include <QDebug>
 #include <QFileInfo>
 #include <QDir>
 #include <QApplication>
+#include <QBuffer>
+#include <QSaveFile>
+#include <QtConcurrent>
+#include <QXmlStreamReader>
+#include <QSet>
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstring>
 
 using namespace std;
 
+// Version of the (xml) face annotation dataset format
+const int ft::FaceDataset::FILE_VERSION = 2;
+
+namespace
+{
+	/** Identification of the binary face annotation dataset files. */
+	const char FADB_MAGIC[4] = { 'F', 'A', 'D', 'B' };
+
+	/**
+	 * Version of the binary face annotation dataset format. The version 1 has no coordinate
+	 * format in the header (its coordinates are always floats).
+	 */
+	const quint32 FADB_VERSION = 2;
+
+	/** Size of the header of the version 1 of the binary format. */
+	const quint64 FADB_V1_HEADER_SIZE = 72;
+
+	/** Formats of the coordinates in the binary face annotation dataset files. */
+	enum FadbCoordinateFormat
+	{
+		/** float32 values, in pixels. */
+		FadbFloat32 = 0,
+
+		/** int16 fixed-point values, in 1/FaceImage::FIXED_POINT_SCALE pixels. */
+		FadbFixed16
+	};
+
+	/** Marker used to detect files written in a different byte order. */
+	const quint32 FADB_BYTE_ORDER = 0x01020304;
+
+	/**
+	 * Header of the binary face annotation dataset files (.fadb). The header is followed
+	 * by the sections it refers to, each one starting at an offset aligned to 8 bytes:
+	 * - coordinates: array with numSamples x numFeatures x 2 values (x, y), in the format
+	 *   given by coordinateFormat;
+	 * - connections: array with numConnections pairs of int32 (source, target), shared
+	 *   by all samples;
+	 * - path data: UTF-8 bytes of all image paths (relative to the dataset file);
+	 * - paths: array with numSamples FadbPath entries locating each path in the path data.
+	 */
+	struct FadbHeader
+	{
+		char aMagic[4];
+		quint32 iVersion;
+		quint32 iByteOrder;
+		quint32 iNumFeatures;
+		quint64 iNumSamples;
+		quint64 iNumConnections;
+		quint64 iCoordinatesOffset;
+		quint64 iConnectionsOffset;
+		quint64 iPathDataOffset;
+		quint64 iPathDataSize;
+		quint64 iPathsOffset;
+		quint32 iCoordinateFormat;
+		quint32 iReserved;
+	};
+	Q_STATIC_ASSERT(sizeof(FadbHeader) == 80);
+
+	/** Location of an image path in the path data section of a binary dataset file. */
+	struct FadbPath
+	{
+		quint64 iOffset;
+		quint64 iLength;
+	};
+
+	/**
+	 * Writes zeros to the given device until its position is aligned to 8 bytes.
+	 * @param pDevice QIODevice to write to.
+	 */
+	void alignTo8(QIODevice *pDevice)
+	{
+		static const char aZeros[8] = { 0 };
+		qint64 iPad = (8 - pDevice->pos() % 8) % 8;
+		if(iPad)
+			pDevice->write(aZeros, iPad);
+	}
+
+	/**
+	 * Checks if the section of the given size starting at the given offset fits into a file.
+	 * @param iOffset Offset of the section in the file.
+	 * @param iCount Number of items in the section.
+	 * @param iItemSize Size in bytes of each item.
+	 * @param iFileSize Size in bytes of the file.
+	 * @return Boolean indicating if the section is inside the file (true) or not (false).
+	 */
+	bool sectionFits(quint64 iOffset, quint64 iCount, quint64 iItemSize, quint64 iFileSize)
+	{
+		if(iOffset > iFileSize || iOffset % 8 != 0)
+			return false;
+		return iItemSize == 0 || iCount <= (iFileSize - iOffset) / iItemSize;
+	}
+
+	/**
+	 * First version of the (xml) dataset format in which the connections are stored once for
+	 * the whole dataset. In the previous versions they are stored in every feature of every
+	 * sample (and collapsed into a single topology when read).
+	 */
+	const int TOPOLOGY_VERSION = 2;
+
+	/** Approximate amount of bytes of samples parsed together by each parallel task. */
+	const qint64 SAMPLE_BLOCK_SIZE = 1 << 20;
+
+	/**
+	 * Details of an error found while loading a face annotation dataset from xml.
+	 */
+	struct LoadError
+	{
+		/** Description of the error (the reader error string, in case of syntax errors). */
+		QString sError;
+
+		/** Indication if the error is in the xml syntax (that is reported with line and column). */
+		bool bSyntax;
+
+		/** Line of the syntax error. */
+		qint64 iLine;
+
+		/** Column of the syntax error. */
+		qint64 iColumn;
+
+		/** Index of the sample where the error happened, or -1 if it was not in a sample. */
+		int iSample;
+
+		/** Image file name of the sample where the error happened. */
+		QString sSampleFile;
+
+		LoadError(): bSyntax(false), iLine(0), iColumn(0), iSample(-1) {}
+	};
+
+	/**
+	 * Builds the message for the given error in the given file.
+	 * @param sFileName QString with the name of the file being loaded.
+	 * @param oError LoadError with the error details.
+	 * @return QString with the message to report to the user.
+	 */
+	QString errorMessage(const QString &sFileName, const LoadError &oError)
+	{
+		// The location is translated as a whole, so the brackets are balanced in every string
+		QString sWhere;
+		if(oError.iSample >= 0)
+			sWhere = QString(QApplication::translate("FaceDataset", "the file [%1], sample [%2] (%3)")).arg(sFileName, QString::number(oError.iSample + 1), oError.sSampleFile);
+		else
+			sWhere = QString(QApplication::translate("FaceDataset", "the file [%1]")).arg(sFileName);
+
+		if(oError.bSyntax)
+			return QString(QApplication::translate("FaceDataset", "there is an error in the contents of %1: error [%2], line [%3], column [%4]")).arg(sWhere, oError.sError, QString::number(oError.iLine), QString::number(oError.iColumn));
+		else
+			return QString(QApplication::translate("FaceDataset", "there is an error in the contents of %1: %2")).arg(sWhere, oError.sError);
+	}
+
+	/**
+	 * Stores the syntax error of the given reader (if any) in the given error details.
+	 * @param oReader QXmlStreamReader to check.
+	 * @param oError LoadError to receive the error details.
+	 */
+	void checkSyntaxError(const QXmlStreamReader &oReader, LoadError &oError)
+	{
+		if(!oReader.hasError())
+			return;
+
+		oError.bSyntax = true;
+		oError.sError = oReader.errorString();
+		oError.iLine = oReader.lineNumber();
+		oError.iColumn = oReader.columnNumber();
+	}
+
+	/**
+	 * Reads all sample nodes inside the node at which the given reader is positioned.
+	 * @param oReader QXmlStreamReader positioned at the start of the parent node of the samples.
+	 * @param oPaths PathTable used to resolve the image file names relative to the dataset file.
+	 * @param iNumFeats Integer with the number of features expected in each sample.
+	 * @param iFirstSample Integer with the index in the dataset of the first sample read.
+	 * @param pTopology Pointer to the FaceTopology to receive the connections stored in the
+	 * samples (in the old versions of the format), or NULL if they are not read.
+	 * @param oPool FaceImagePool from which the samples are created.
+	 * @param vSamples Vector to receive the samples read.
+	 * @param oError LoadError to receive the error details in case the method fails.
+	 * @return Boolean indicating if the reading was successful (true) or if it failed (false).
+	 */
+	bool readSamples(QXmlStreamReader &oReader, ft::PathTable &oPaths, int iNumFeats, int iFirstSample, ft::FaceTopology *pTopology, ft::FaceImagePool &oPool, vector<ft::FaceImage*> &vSamples, LoadError &oError)
+	{
+		int iSample = iFirstSample;
+		while(oReader.readNextStartElement())
+		{
+			QString sFile = oReader.attributes().value("fileName").toString();
+
+			ft::FaceImage *pSample = oPool.create();
+			if(!pSample->loadFromXML(oReader, oPaths, oError.sError, iNumFeats, pTopology))
+			{
+				oPool.destroy(pSample);
+				oError.iSample = iSample;
+				oError.sSampleFile = sFile;
+				checkSyntaxError(oReader, oError);
+				return false;
+			}
+			vSamples.push_back(pSample);
+			iSample++;
+		}
+
+		checkSyntaxError(oReader, oError);
+		return !oError.bSyntax;
+	}
+
+	/**
+	 * Reads a complete face annotation dataset document from the given device, in a single pass.
+	 * @param pDevice QIODevice to read the xml document from.
+	 * @param oBase QDir used to resolve the image file names relative to the dataset file.
+	 * @param iNumFeats Integer to receive the number of features in the dataset.
+	 * @param iVersion Integer to receive the version of the format of the document.
+	 * @param oTopology FaceTopology to receive the connections among the features.
+	 * @param oPool FaceImagePool from which the samples are created.
+	 * @param vSamples Vector to receive the samples read.
+	 * @param oError LoadError to receive the error details in case the method fails.
+	 * @return Boolean indicating if the reading was successful (true) or if it failed (false).
+	 */
+	bool readDocument(QIODevice *pDevice, const QDir &oBase, int &iNumFeats, int &iVersion, ft::FaceTopology &oTopology, ft::FaceImagePool &oPool, vector<ft::FaceImage*> &vSamples, LoadError &oError)
+	{
+		QXmlStreamReader oReader(pDevice);
+
+		// Root node
+		if(!oReader.readNextStartElement() || oReader.name() != "FaceDataset")
+		{
+			checkSyntaxError(oReader, oError);
+			if(!oError.bSyntax)
+				oError.sError = QApplication::translate("FaceDataset", "the node '%1' does not exist").arg("FaceDataset");
+			return false;
+		}
+
+		QXmlStreamAttributes oAttributes = oReader.attributes();
+		bool bValid;
+		iNumFeats = oAttributes.value("numberOfFeatures").toInt(&bValid);
+		if(!bValid || iNumFeats < 0)
+		{
+			oError.sError = QApplication::translate("FaceDataset", "the attribute '%1' does not exist or it contains an invalid value").arg("numberOfFeatures");
+			return false;
+		}
+
+		// The files written before the version attribute existed are of version 1
+		QStringRef sVersion = oAttributes.value("version");
+		iVersion = sVersion.isEmpty() ? 1 : sVersion.toInt(&bValid);
+		if(!bValid || iVersion < 1 || iVersion > ft::FaceDataset::FILE_VERSION)
+		{
+			oError.sError = QApplication::translate("FaceDataset", "the version [%1] of the file is not supported").arg(sVersion.toString());
+			return false;
+		}
+
+		// Connections (for the whole dataset) and sample images
+		bool bConnections = false;
+		bool bSamples = false;
+		while(oReader.readNextStartElement())
+		{
+			if(oReader.name() == "Connections" && !bConnections && iVersion >= TOPOLOGY_VERSION)
+			{
+				bConnections = true;
+				if(!oTopology.loadFromXML(oReader, oError.sError))
+				{
+					checkSyntaxError(oReader, oError);
+					return false;
+				}
+				continue;
+			}
+
+			if(oReader.name() != "Samples" || bSamples)
+			{
+				oReader.skipCurrentElement();
+				continue;
+			}
+
+			bSamples = true;
+			ft::PathTable oPaths(oBase);
+			if(!readSamples(oReader, oPaths, iNumFeats, 0, iVersion < TOPOLOGY_VERSION ? &oTopology : NULL, oPool, vSamples, oError))
+				return false;
+		}
+
+		// Read until the end of the document, so syntax errors after the
+		// samples are also reported
+		while(!oReader.atEnd())
+			oReader.readNext();
+
+		checkSyntaxError(oReader, oError);
+		if(oError.bSyntax)
+			return false;
+
+		if(!bSamples)
+		{
+			oError.sError = QApplication::translate("FaceDataset", "the node '%1' does not exist").arg("Samples");
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Counts the line breaks in the given data.
+	 * @param pData Pointer to the data.
+	 * @param iSize Size in bytes of the data.
+	 * @return Number of line breaks found.
+	 */
+	qint64 countLines(const char *pData, qint64 iSize)
+	{
+		qint64 iLines = 0;
+		const char *pEnd = pData + iSize;
+		while((pData = (const char*) memchr(pData, '\n', pEnd - pData)) != NULL)
+		{
+			iLines++;
+			pData++;
+		}
+		return iLines;
+	}
+
+	/**
+	 * Indicates if the given text starts at the given position.
+	 * @param p Pointer to the position in the data.
+	 * @param pEnd Pointer to the end of the data.
+	 * @param sText Text to compare.
+	 * @return Boolean indicating if the text is at the position (true) or not (false).
+	 */
+	bool startsWith(const char *p, const char *pEnd, const char *sText)
+	{
+		size_t iLen = strlen(sText);
+		return (size_t) (pEnd - p) >= iLen && memcmp(p, sText, iLen) == 0;
+	}
+
+	/**
+	 * Finds the given text in the data.
+	 * @param p Pointer to the position where to start the search.
+	 * @param pEnd Pointer to the end of the data.
+	 * @param sText Text to find.
+	 * @return Pointer to the first occurrence of the text, or NULL if it was not found.
+	 */
+	const char* findText(const char *p, const char *pEnd, const char *sText)
+	{
+		while(p < pEnd && (p = (const char*) memchr(p, sText[0], pEnd - p)) != NULL)
+		{
+			if(startsWith(p, pEnd, sText))
+				return p;
+			p++;
+		}
+		return NULL;
+	}
+
+	/**
+	 * Finds the end of the xml tag starting at the given position (ignoring any '>' in quoted values).
+	 * @param p Pointer to the start of the tag.
+	 * @param pEnd Pointer to the end of the data.
+	 * @return Pointer to the '>' character closing the tag, or NULL if it was not found.
+	 */
+	const char* findTagEnd(const char *p, const char *pEnd)
+	{
+		char cQuote = 0;
+		for(; p < pEnd; p++)
+		{
+			if(cQuote)
+			{
+				if(*p == cQuote)
+					cQuote = 0;
+			}
+			else if(*p == '"' || *p == '\'')
+				cQuote = *p;
+			else if(*p == '>')
+				return p;
+		}
+		return NULL;
+	}
+
+	/**
+	 * Indicates if the xml document in the given data is encoded in UTF-8 (the only encoding
+	 * in which parts of the document can be parsed separately).
+	 * @param pData Pointer to the data.
+	 * @param iSize Size in bytes of the data.
+	 * @return Boolean indicating if the document is in UTF-8 (true) or not (false).
+	 */
+	bool isUtf8(const char *pData, qint64 iSize)
+	{
+		const char *pEnd = pData + iSize;
+		if(startsWith(pData, pEnd, "\xEF\xBB\xBF"))
+			pData += 3;
+		if(!startsWith(pData, pEnd, "<?xml"))
+			return !startsWith(pData, pEnd, "\xFF\xFE") && !startsWith(pData, pEnd, "\xFE\xFF");
+
+		const char *pDeclEnd = findText(pData, pEnd, "?>");
+		if(!pDeclEnd)
+			return false;
+
+		QByteArray sDecl = QByteArray(pData, pDeclEnd - pData).toLower();
+		int iPos = sDecl.indexOf("encoding");
+		return iPos == -1 || sDecl.indexOf("utf-8", iPos) != -1;
+	}
+
+	/**
+	 * Gets the position in the given UTF-8 data of the given character offset (counted in
+	 * UTF-16 code units, as done by QXmlStreamReader).
+	 * @param pData Pointer to the data.
+	 * @param pEnd Pointer to the end of the data.
+	 * @param iChars Offset in characters from the start of the document.
+	 * @return Pointer to the position of the character in the data.
+	 */
+	const char* utf8Position(const char *pData, const char *pEnd, qint64 iChars)
+	{
+		// The byte order mark is not counted by the reader
+		const char *p = pData;
+		if(startsWith(p, pEnd, "\xEF\xBB\xBF"))
+			p += 3;
+
+		while(iChars > 0 && p < pEnd)
+		{
+			unsigned char c = (unsigned char) *p;
+			int iLen = c < 0xC0 ? 1 : (c < 0xE0 ? 2 : (c < 0xF0 ? 3 : 4));
+			iChars -= iLen == 4 ? 2 : 1; // The characters out of the BMP take two code units
+			p += iLen;
+		}
+		return qMin(p, pEnd);
+	}
+
+	/**
+	 * Scans the given xml data for the byte ranges of the sample nodes, without parsing them.
+	 * @param pData Pointer to the data.
+	 * @param iSize Size in bytes of the data.
+	 * @param iContentStart Integer to receive the offset of the contents of the Samples node.
+	 * @param iContentEnd Integer to receive the offset of the end of the contents of the Samples node.
+	 * @param vRanges Vector to receive the offset and size in bytes of each sample node.
+	 * @return Boolean indicating if the samples were found (true) or if the data does not have
+	 * the expected layout and must be parsed sequentially (false).
+	 */
+	bool findSamples(const char *pData, qint64 iSize, qint64 &iContentStart, qint64 &iContentEnd, vector<pair<qint64, qint64> > &vRanges)
+	{
+		const char *pEnd = pData + iSize;
+
+		// Start of the Samples node. It is found by the xml reader, so the same text in
+		// a comment, a CDATA section or an attribute value is not taken for the node
+		QXmlStreamReader oReader(QByteArray::fromRawData(pData, (int) qMin(iSize, (qint64) INT_MAX)));
+		int iDepth = 0;
+		bool bFound = false;
+		while(!bFound && !oReader.atEnd())
+		{
+			QXmlStreamReader::TokenType eToken = oReader.readNext();
+			if(eToken == QXmlStreamReader::StartElement)
+				bFound = ++iDepth == 2 && oReader.name() == "Samples";
+			else if(eToken == QXmlStreamReader::EndElement)
+				iDepth--;
+		}
+		if(!bFound)
+			return false;
+
+		// The reader is right after the start tag. Its offset is in characters, so it is
+		// converted to bytes (and checked, since it must be right after a '>')
+		const char *p = utf8Position(pData, pEnd, oReader.characterOffset());
+		if(p <= pData || p[-1] != '>' || (p - pData >= 2 && p[-2] == '/'))
+			return false;
+		iContentStart = p - pData;
+
+		// Sample nodes, up to the end of the Samples node
+		while((p = (const char*) memchr(p, '<', pEnd - p)) != NULL)
+		{
+			const char *pStart = p;
+			if(startsWith(p, pEnd, "</Samples"))
+			{
+				iContentEnd = p - pData;
+				return true;
+			}
+			else if(startsWith(p, pEnd, "<!--"))
+			{
+				if(!(p = findText(p, pEnd, "-->")))
+					return false;
+			}
+			else if(startsWith(p, pEnd, "<Sample") && p + 7 < pEnd && (isspace((unsigned char) p[7]) || p[7] == '>' || p[7] == '/'))
+			{
+				if(!(p = findTagEnd(p, pEnd)))
+					return false;
+				if(p[-1] != '/' && (!(p = findText(p, pEnd, "</Sample")) || !(p = findTagEnd(p, pEnd))))
+					return false;
+				vRanges.push_back(make_pair(pStart - pData, p + 1 - pStart));
+			}
+			else
+				return false;
+			p++;
+		}
+
+		return false;
+	}
+
+	/**
+	 * Group of consecutive sample nodes parsed together by one of the parallel tasks.
+	 */
+	struct SampleBlock
+	{
+		/** Pointer to the data of the whole dataset file. */
+		const char *pData;
+
+		/** Offset of the first sample node in the data. */
+		qint64 iOffset;
+
+		/** Size in bytes of the block (from the start of the first sample to the end of the last one). */
+		qint64 iLength;
+
+		/** Index in the dataset of the first sample in the block. */
+		int iFirstSample;
+
+		/** Number of samples in the block. */
+		int iNumSamples;
+
+		/** Directory used to resolve the image file names relative to the dataset file. */
+		QString sBasePath;
+
+		/** Number of features expected in each sample. */
+		int iNumFeats;
+
+		/** Indication if the connections stored in the samples are read (old versions of the format). */
+		bool bConnections;
+
+		/** Pool from which the samples of the block are created (one per block, since each task runs in its own thread). */
+		ft::FaceImagePool *pPool;
+
+		/** Samples read from the block. */
+		vector<ft::FaceImage*> vSamples;
+
+		/** Connections read from the samples in the block. */
+		ft::FaceTopology oTopology;
+
+		/** Indication if the reading of the block failed. */
+		bool bFailed;
+
+		/** Details of the error, in case the reading failed. */
+		LoadError oError;
+	};
+
+	/**
+	 * Reads the samples in the given block (used by the parallel tasks).
+	 * @param oBlock SampleBlock with the data to read.
+	 */
+	void readSampleBlock(SampleBlock &oBlock)
+	{
+		// The block is wrapped in a parent node, so the reader sees a single
+		// document with all its samples
+		QXmlStreamReader oReader;
+		oReader.addData(QByteArray("<Samples>"));
+		oReader.addData(QByteArray::fromRawData(oBlock.pData + oBlock.iOffset, oBlock.iLength));
+		oReader.addData(QByteArray("</Samples>"));
+		oReader.readNextStartElement();
+
+		ft::PathTable oPaths(QDir(oBlock.sBasePath));
+		oBlock.pPool->reserve(oBlock.iNumSamples);
+		oBlock.bFailed = !readSamples(oReader, oPaths, oBlock.iNumFeats, oBlock.iFirstSample, oBlock.bConnections ? &oBlock.oTopology : NULL, *oBlock.pPool, oBlock.vSamples, oBlock.oError);
+	}
+
+	/**
+	 * Reads the face annotation dataset document from the given data, skipping the
+	 * contents of the Samples node.
+	 * @param pData Pointer to the data of the whole dataset file.
+	 * @param iSize Size in bytes of the data.
+	 * @param iContentStart Integer with the offset of the contents of the Samples node.
+	 * @param iContentEnd Integer with the offset of the end of the contents of the Samples node.
+	 * @param iNumFeats Integer to receive the number of features in the dataset.
+	 * @param iVersion Integer to receive the version of the format of the document.
+	 * @param oTopology FaceTopology to receive the connections among the features.
+	 * @param oError LoadError to receive the error details in case the method fails.
+	 * @return Boolean indicating if the reading was successful (true) or if it failed (false).
+	 */
+	bool readSkeleton(const char *pData, qint64 iSize, qint64 iContentStart, qint64 iContentEnd, int &iNumFeats, int &iVersion, ft::FaceTopology &oTopology, LoadError &oError)
+	{
+		QByteArray oSkeleton;
+		oSkeleton.reserve(iContentStart + iSize - iContentEnd);
+		oSkeleton.append(pData, iContentStart);
+		oSkeleton.append(pData + iContentEnd, iSize - iContentEnd);
+
+		QBuffer oBuffer(&oSkeleton);
+		oBuffer.open(QIODevice::ReadOnly);
+		ft::FaceImagePool oNone;
+		vector<ft::FaceImage*> vNone;
+		if(!readDocument(&oBuffer, QDir(), iNumFeats, iVersion, oTopology, oNone, vNone, oError))
+		{
+			// Errors after the samples are reported in the lines of the original file
+			qint64 iPrefixLines = countLines(pData, iContentStart);
+			if(oError.bSyntax && oError.iLine > iPrefixLines + 1)
+				oError.iLine += countLines(pData + iContentStart, iContentEnd - iContentStart);
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Reads the sample nodes in the given data in parallel.
+	 * @param pData Pointer to the data of the whole dataset file.
+	 * @param vRanges Vector with the offset and size in bytes of each sample node.
+	 * @param sBasePath QString with the directory used to resolve the image file names.
+	 * @param iNumFeats Integer with the number of features expected in each sample.
+	 * @param pTopology Pointer to the FaceTopology to receive the connections stored in the
+	 * samples (in the old versions of the format), or NULL if they are not read.
+	 * @param oPool FaceImagePool to receive the memory of the samples read.
+	 * @param vSamples Vector to receive the samples read.
+	 * @param oError LoadError to receive the error details in case the method fails.
+	 * @return Boolean indicating if the reading was successful (true) or if it failed (false).
+	 */
+	bool readSamplesInBlocks(const char *pData, const vector<pair<qint64, qint64> > &vRanges, const QString &sBasePath, int iNumFeats, ft::FaceTopology *pTopology, ft::FaceImagePool &oPool, vector<ft::FaceImage*> &vSamples, LoadError &oError)
+	{
+		/******************************************************
+		 * Read the samples in parallel
+		 ******************************************************/
+		vector<SampleBlock> vBlocks;
+		for(int i = 0; i < (int) vRanges.size(); i++)
+		{
+			if(vBlocks.empty() || vBlocks.back().iLength >= SAMPLE_BLOCK_SIZE)
+			{
+				SampleBlock oBlock;
+				oBlock.pData = pData;
+				oBlock.iOffset = vRanges[i].first;
+				oBlock.iFirstSample = i;
+				oBlock.iNumSamples = 0;
+				oBlock.sBasePath = sBasePath;
+				oBlock.iNumFeats = iNumFeats;
+				oBlock.bConnections = pTopology != NULL;
+				oBlock.bFailed = false;
+				oBlock.pPool = new ft::FaceImagePool();
+				vBlocks.push_back(oBlock);
+			}
+			vBlocks.back().iLength = vRanges[i].first + vRanges[i].second - vBlocks.back().iOffset;
+			vBlocks.back().iNumSamples++;
+		}
+
+		QtConcurrent::blockingMap(vBlocks, readSampleBlock);
+
+		// Concatenate the samples in order (or report the first error)
+		bool bFailed = false;
+		for(int i = 0; i < (int) vBlocks.size(); i++)
+		{
+			SampleBlock &oBlock = vBlocks[i];
+			if(oBlock.bFailed && !bFailed)
+			{
+				bFailed = true;
+				oError = oBlock.oError;
+
+				// Convert the position of syntax errors from the block to the file
+				if(oError.bSyntax)
+				{
+					const char *pLineStart = pData + oBlock.iOffset;
+					while(pLineStart > pData && pLineStart[-1] != '\n')
+						pLineStart--;
+					if(oError.iLine == 1)
+						oError.iColumn += pData + oBlock.iOffset - pLineStart - (int) strlen("<Samples>");
+					oError.iLine += countLines(pData, oBlock.iOffset);
+				}
+			}
+		}
+
+		if(bFailed)
+		{
+			for(int i = 0; i < (int) vBlocks.size(); i++)
+			{
+				foreach(ft::FaceImage *pSample, vBlocks[i].vSamples)
+					vBlocks[i].pPool->destroy(pSample);
+				delete vBlocks[i].pPool;
+			}
+			return false;
+		}
+
+		vSamples.reserve(vRanges.size());
+		for(int i = 0; i < (int) vBlocks.size(); i++)
+		{
+			vSamples.insert(vSamples.end(), vBlocks[i].vSamples.begin(), vBlocks[i].vSamples.end());
+			if(pTopology)
+				pTopology->merge(vBlocks[i].oTopology);
+			oPool.merge(*vBlocks[i].pPool);
+			delete vBlocks[i].pPool;
+		}
+		return true;
+	}
+
+	/**
+	 * Reads the value of the fileName attribute from the start tag of the sample node at
+	 * the given position.
+	 * @param pStart Pointer to the start of the sample node.
+	 * @param pEnd Pointer to the end of the sample node.
+	 * @return QString with the file name, or an empty string if it was not found.
+	 */
+	QString readSampleFileName(const char *pStart, const char *pEnd)
+	{
+		const char *pTagEnd = findTagEnd(pStart, pEnd);
+		if(!pTagEnd)
+			return QString();
+
+		// Quick path for the usual attribute, without any references to decode
+		const char *p = findText(pStart, pTagEnd, "fileName");
+		if(p && isspace((unsigned char) p[-1]))
+		{
+			p += 8;
+			while(p < pTagEnd && isspace((unsigned char) *p))
+				p++;
+			if(p < pTagEnd && *p++ == '=')
+			{
+				while(p < pTagEnd && isspace((unsigned char) *p))
+					p++;
+				if(p < pTagEnd && (*p == '"' || *p == '\''))
+				{
+					const char *pValueEnd = (const char*) memchr(p + 1, *p, pTagEnd - p - 1);
+					if(pValueEnd && !memchr(p + 1, '&', pValueEnd - p - 1))
+						return QString::fromUtf8(p + 1, pValueEnd - p - 1);
+				}
+			}
+		}
+
+		// Otherwise, let the xml reader handle the tag
+		QXmlStreamReader oReader(QByteArray::fromRawData(pStart, pTagEnd + 1 - pStart));
+		if(!oReader.readNextStartElement())
+			return QString();
+		return oReader.attributes().value("fileName").toString();
+	}
+
+	/**
+	 * Creates the samples in the given data without parsing their contents (only their
+	 * file names and the location of their nodes in the data are stored).
+	 * @param pData Pointer to the data of the whole dataset file.
+	 * @param vRanges Vector with the offset and size in bytes of each sample node.
+	 * @param oBase QDir used to resolve the image file names relative to the dataset file.
+	 * @param oPool FaceImagePool from which the samples are created.
+	 * @param vSamples Vector to receive the samples indexed.
+	 * @param oError LoadError to receive the error details in case the method fails.
+	 * @return Boolean indicating if the indexing was successful (true) or if it failed (false).
+	 */
+	bool indexSamples(const char *pData, const vector<pair<qint64, qint64> > &vRanges, const QDir &oBase, ft::FaceImagePool &oPool, vector<ft::FaceImage*> &vSamples, LoadError &oError)
+	{
+		ft::PathTable oPaths(oBase);
+		oPool.reserve(vRanges.size());
+		vSamples.reserve(vRanges.size());
+		for(int i = 0; i < (int) vRanges.size(); i++)
+		{
+			const char *pStart = pData + vRanges[i].first;
+			QString sFile = readSampleFileName(pStart, pStart + vRanges[i].second);
+			if(sFile.isEmpty())
+			{
+				oError.iSample = i;
+				oError.sError = QApplication::translate("FaceImage", "the attribute '%1' does not exist or it contains an invalid value").arg("fileName");
+				return false;
+			}
+
+			int iDirectory;
+			QString sBaseName;
+			oPaths.resolve(sFile, iDirectory, sBaseName);
+
+			ft::FaceImage *pSample = oPool.create();
+			pSample->setFileName(iDirectory, sBaseName);
+			pSample->setSource(vRanges[i].first, vRanges[i].second, false);
+			vSamples.push_back(pSample);
+		}
+
+		return true;
+	}
+}
+
+// +-----------------------------------------------------------
+ft::FaceDataset::FaceDataset()
+{
+	m_iNumFeatures = 0;
+	m_bCompact = false;
+	m_pSourceData = NULL;
+	m_iSourceVersion = 0;
+	m_bCoordinatesConverted = false;
+	m_bBinarySource = false;
+}
+
+// +-----------------------------------------------------------
+ft::FaceDataset::~FaceDataset()
+{
+	clear();
+}
+
+// +-----------------------------------------------------------
+int ft::FaceDataset::size() const
+{
+	return m_vSamples.size();
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDataset::loadFromFile(const QString &sFileName, QString &sMsgError, bool bLazy)
+{
+	if(isBinaryFile(sFileName) && !isCompressedFile(sFileName))
+		return loadFromBinaryFile(sFileName, sMsgError);
+
+	/******************************************************
+	 * Open the file
+	 ******************************************************/
+	QSharedPointer<QFile> pFile(new QFile(sFileName));
+	if (!pFile->open(QFile::ReadOnly))
+    {
+		sMsgError = QString(QApplication::translate("FaceDataset", "it was not possible to read from file [%1]")).arg(sFileName);
+        return false;
+    }
+
+	// Used to resolve the image file names relative to the saved file path
+	QString sBasePath = QFileInfo(sFileName).absolutePath();
+
+	/******************************************************
+	 * Compressed files are parsed in a single pass, as
+	 * they are decompressed
+	 ******************************************************/
+	if(isCompressedFile(sFileName))
+	{
+		int iNumFeats = 0;
+		int iVersion = 0;
+		FaceTopology oTopology;
+		FaceImagePool oPool;
+		vector<FaceImage*> vSamples;
+		LoadError oError;
+
+		// The format of the compressed data is identified by its contents (so a binary
+		// dataset is recognized whatever the extension before the .gz is)
+		GzipDevice oGzip(pFile.data());
+		bool bOpened = oGzip.open(QIODevice::ReadOnly);
+		if(bOpened && oGzip.peek(sizeof(FADB_MAGIC)) == QByteArray(FADB_MAGIC, sizeof(FADB_MAGIC)))
+		{
+			// The binary data can not be mapped, so it is decompressed to memory (and
+			// kept there, as the source of the images)
+			QByteArray oData = oGzip.readAll();
+			if(oGzip.hasError())
+			{
+				oError.sError = oGzip.errorString();
+				sMsgError = errorMessage(sFileName, oError);
+				return false;
+			}
+
+			// Only the name of the file is needed then
+			pFile->close();
+			if(!loadFromBinaryData(pFile, reinterpret_cast<const uchar*>(oData.constData()), oData.size(), sMsgError))
+				return false;
+			if(m_bBinarySource)
+				m_oSourceBuffer = oData;
+			return true;
+		}
+
+		bool bLoaded = bOpened && readDocument(&oGzip, QDir(sBasePath), iNumFeats, iVersion, oTopology, oPool, vSamples, oError);
+		if(oGzip.hasError())
+		{
+			bLoaded = false;
+			oError = LoadError();
+			oError.sError = oGzip.errorString();
+		}
+
+		if(!bLoaded)
+		{
+			foreach(FaceImage *pSamp, vSamples)
+				oPool.destroy(pSamp);
+
+			sMsgError = errorMessage(sFileName, oError);
+			return false;
+		}
+
+		clear();
+		m_iNumFeatures = iNumFeats;
+		m_oTopology = oTopology;
+		m_oPool.merge(oPool);
+		m_vSamples = vSamples;
+		setCompactCoordinates(m_bCompact);
+		return true;
+	}
+
+	/******************************************************
+	 * Parse the xml document (directly from the file and
+	 * without building a DOM tree). If the file can be
+	 * mapped, the sample nodes are located with a quick
+	 * scan and parsed in parallel (or only indexed, if
+	 * the file is opened lazily); otherwise, the whole
+	 * document is parsed in a single pass.
+	 ******************************************************/
+	int iNumFeats = 0;
+	int iVersion = 0;
+	FaceTopology oTopology;
+	FaceImagePool oPool;
+	vector<FaceImage*> vSamples;
+	LoadError oError;
+	bool bLoaded;
+	bool bMapped = false;
+
+	qint64 iSize = pFile->size();
+	const char *pData = iSize > 0 ? (const char*) pFile->map(0, iSize) : NULL;
+	qint64 iContentStart, iContentEnd;
+	vector<pair<qint64, qint64> > vRanges;
+
+	if(pData && isUtf8(pData, iSize) && findSamples(pData, iSize, iContentStart, iContentEnd, vRanges))
+	{
+		bLoaded = readSkeleton(pData, iSize, iContentStart, iContentEnd, iNumFeats, iVersion, oTopology, oError);
+		if(bLoaded && bLazy)
+		{
+			bLoaded = indexSamples(pData, vRanges, QDir(sBasePath), oPool, vSamples, oError);
+
+			// In the old versions of the format the connections are only found
+			// in the samples, so they are taken from the first one
+			if(bLoaded && iVersion < TOPOLOGY_VERSION && !vRanges.empty())
+			{
+				FaceImage oFirst;
+				QString sError;
+				oFirst.loadFromXML(QByteArray::fromRawData(pData + vRanges[0].first, vRanges[0].second), QDir(sBasePath), sError, iNumFeats, &oTopology);
+			}
+		}
+		else if(bLoaded)
+			bLoaded = readSamplesInBlocks(pData, vRanges, sBasePath, iNumFeats, iVersion < TOPOLOGY_VERSION ? &oTopology : NULL, oPool, vSamples, oError);
+
+		// The samples remember their nodes in the file, so the unchanged
+		// ones can be copied as they are when the dataset is saved
+		if(bLoaded)
+		{
+			for(int i = 0; i < (int) vSamples.size(); i++)
+				vSamples[i]->setSource(vRanges[i].first, vRanges[i].second, vSamples[i]->isLoaded());
+			bMapped = true;
+		}
+	}
+	else
+	{
+		pFile->seek(0);
+		bLoaded = readDocument(pFile.data(), QDir(sBasePath), iNumFeats, iVersion, oTopology, oPool, vSamples, oError);
+	}
+
+	// The file is kept open only to read the samples from it later
+	if(!bMapped)
+		pFile->close();
+
+	if(!bLoaded)
+	{
+		foreach(FaceImage *pSamp, vSamples)
+			oPool.destroy(pSamp);
+
+		sMsgError = errorMessage(sFileName, oError);
+		return false;
+	}
+
+	clear();
+	m_iNumFeatures = iNumFeats;
+	m_oTopology = oTopology;
+	m_oPool.merge(oPool);
+	m_vSamples = vSamples;
+	setCompactCoordinates(m_bCompact);
+	if(bMapped && !m_vSamples.empty())
+	{
+		m_pSource = pFile;
+		m_pSourceData = pData;
+		m_iSourceVersion = iVersion;
+
+		// The samples read in the compact mode are rounded when they are loaded, so they
+		// differ from their nodes in the file (as if the mode was changed after the loading)
+		m_bCoordinatesConverted = m_bCompact;
+	}
+
+	return true;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDataset::saveToFile(const QString &sFileName, QString &sMsgError)
+{
+	if(isBinaryFile(sFileName))
+	{
+		// The samples that can not be read are not replaced in the file
+		if(!loadAllSamples(sMsgError))
+			return false;
+
+		// All the images are loaded, so the source file is no longer needed (and
+		// it can not be replaced while it is mapped in some systems)
+		if(m_pSource && QFileInfo(m_pSource->fileName()) == QFileInfo(sFileName))
+			releaseSource();
+		return saveToBinaryFile(sFileName, sMsgError);
+	}
+
+	FaceDatasetSnapshot *pSnapshot = createSnapshot(sFileName);
+	pSnapshot->write();
+	bool bRet = commitSnapshot(pSnapshot, sMsgError);
+	delete pSnapshot;
+
+	return bRet;
+}
+
+// +-----------------------------------------------------------
+ft::FaceDatasetSnapshot* ft::FaceDataset::createSnapshot(const QString &sFileName) const
+{
+	FaceDatasetSnapshot *pSnapshot = new FaceDatasetSnapshot(sFileName);
+	pSnapshot->m_bCompressed = isCompressedFile(sFileName);
+	pSnapshot->m_iNumFeatures = m_iNumFeatures;
+	pSnapshot->m_oTopology = m_oTopology;
+
+	// The snapshot can only parse the samples from a xml file
+	if(!m_bBinarySource)
+	{
+		pSnapshot->m_pSource = m_pSource;
+		pSnapshot->m_pSourceData = m_pSourceData;
+	}
+
+	// The nodes of the samples in the source file can only be copied unchanged
+	// if their (relative) file names are still valid in the new file, if they
+	// are written in the current version of the format and if their coordinates
+	// are stored as they are now (otherwise all samples are converted)
+	pSnapshot->m_bCompact = m_bCompact;
+	bool bSameBase = m_pSource && m_iSourceVersion == FILE_VERSION && !m_bCoordinatesConverted && QDir(QFileInfo(sFileName).absolutePath()) == QDir(QFileInfo(m_pSource->fileName()).absolutePath());
+
+	pSnapshot->m_vSamples.resize(m_vSamples.size());
+	for(int i = 0; i < size(); i++)
+	{
+		// The samples of a binary file are read now (the ones that can not be read
+		// fail the saving, since there is no data to write in their places)
+		QString sError;
+		if(m_bBinarySource && !m_vSamples[i]->isLoaded())
+			loadSample(m_vSamples[i], sError);
+
+		const FaceImage *pImage = m_vSamples[i];
+		FaceDatasetSnapshot::Sample &oSample = pSnapshot->m_vSamples[i];
+		oSample.iSourceOffset = pImage->sourceOffset();
+		oSample.iSourceLength = pImage->sourceLength();
+		oSample.iRevision = pImage->revision();
+		oSample.iOffset = -1;
+		oSample.iLength = 0;
+		oSample.bCopy = bSameBase && pImage->hasSource() && !pImage->isModified();
+		oSample.bParse = !oSample.bCopy && !pImage->isLoaded();
+		oSample.pImage = NULL;
+
+		// Only the images to serialize are copied (the ones not loaded yet are
+		// parsed from the source file when the snapshot is written)
+		if(!oSample.bCopy)
+		{
+			oSample.pImage = new FaceImage();
+			oSample.pImage->setFileName(pImage->directory(), pImage->baseName());
+			if(pImage->isLoaded())
+				oSample.pImage->copyFeaturesFrom(pImage);
+		}
+	}
+
+	return pSnapshot;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDataset::commitSnapshot(FaceDatasetSnapshot *pSnapshot, QString &sMsgError)
+{
+	if(!pSnapshot->m_bWritten)
+	{
+		sMsgError = pSnapshot->errorMessage();
+		return false;
+	}
+
+	// The structure of the dataset is not supposed to change while a snapshot
+	// is saved, but if it did the samples can not be matched to the file (so
+	// they are all loaded while the current file is still available)
+	QString sLoadError;
+	bool bMatched = pSnapshot->size() == size();
+	if(!bMatched)
+		loadAllSamples(sLoadError);
+
+	/******************************************************
+	 * Replace the file. If it is the source file, it must
+	 * be released first (it can not be replaced while it
+	 * is mapped in some systems).
+	 ******************************************************/
+	QString sFileName = pSnapshot->fileName();
+	bool bReplacingSource = m_pSource && QFileInfo(m_pSource->fileName()) == QFileInfo(sFileName);
+	if(bReplacingSource)
+		m_pSource->close();
+
+	if(!pSnapshot->m_pFile->commit())
+	{
+		sMsgError = QString(QApplication::translate("FaceDataset", "it was not possible to write to file [%1]")).arg(sFileName);
+		if(bReplacingSource && !openSource(sFileName))
+			releaseSource();
+		return false;
+	}
+
+	// The samples can not be read from a compressed file, so they remain
+	// related to the current source file (if any). The ones serialized are
+	// saved, but if loaded they might differ from their nodes in the source
+	// file, so they are no longer copied from it
+	if(pSnapshot->m_bCompressed)
+	{
+		for(int i = 0; i < size() && bMatched; i++)
+		{
+			const FaceDatasetSnapshot::Sample &oSample = pSnapshot->m_vSamples[i];
+			if(!oSample.bCopy && m_vSamples[i]->isLoaded())
+				m_vSamples[i]->setSource(-1, 0, true);
+			m_vSamples[i]->setSaved(oSample.iRevision);
+		}
+		return true;
+	}
+
+	/******************************************************
+	 * The samples are then read from the new file
+	 ******************************************************/
+	if(!openSource(sFileName))
+	{
+		// Should not happen, but the samples not loaded would be lost
+		if(!bReplacingSource)
+			loadAllSamples(sLoadError);
+		releaseSource();
+		if(bReplacingSource)
+		{
+			sMsgError = QString(QApplication::translate("FaceDataset", "it was not possible to read from file [%1]")).arg(sFileName);
+			return false;
+		}
+		return true;
+	}
+
+	if(!bMatched)
+	{
+		releaseSource();
+		return true;
+	}
+
+	for(int i = 0; i < size(); i++)
+	{
+		const FaceDatasetSnapshot::Sample &oSample = pSnapshot->m_vSamples[i];
+		m_vSamples[i]->setSource(oSample.iOffset, oSample.iLength, m_vSamples[i]->isLoaded());
+		m_vSamples[i]->setSaved(oSample.iRevision);
+	}
+	m_iSourceVersion = FILE_VERSION;
+	m_bCoordinatesConverted = false;
+
+	return true;
+}
+
 // +-----------------------------------------------------------
-ft::FaceDataset::FaceDataset()
+bool ft::FaceDataset::openSource(const QString &sFileName)
 {
-	m_iNumFeatures = 0;
+	QSharedPointer<QFile> pFile(new QFile(sFileName));
+	qint64 iSize = pFile->open(QFile::ReadOnly) ? pFile->size() : 0;
+	const char *pData = iSize > 0 ? (const char*) pFile->map(0, iSize) : NULL;
+	if(!pData)
+		return false;
+
+	m_pSource = pFile;
+	m_pSourceData = pData;
+	m_bBinarySource = false;
+	m_oSourceBuffer.clear();
+	m_pSourcePaths.clear();
+	return true;
 }
 
 // +-----------------------------------------------------------
-ft::FaceDataset::~FaceDataset()
+bool ft::FaceDataset::isBinaryFile(const QString &sFileName)
 {
-	clear();
+	// The extension of the compressed files is the one before the .gz
+	QFileInfo oInfo(sFileName);
+	if(isCompressedFile(sFileName))
+		oInfo = QFileInfo(oInfo.completeBaseName());
+	return oInfo.suffix().compare("fadb", Qt::CaseInsensitive) == 0;
 }
 
 // +-----------------------------------------------------------
-int ft::FaceDataset::size() const
+bool ft::FaceDataset::isCompressedFile(const QString &sFileName)
 {
-	return m_vSamples.size();
+	return QFileInfo(sFileName).suffix().compare("gz", Qt::CaseInsensitive) == 0;
 }
 
 // +-----------------------------------------------------------
-bool ft::FaceDataset::loadFromFile(const QString &sFileName, QString &sMsgError)
+bool ft::FaceDataset::loadFromBinaryFile(const QString &sFileName, QString &sMsgError)
 {
 	/******************************************************
-	 * Open and read the file
+	 * Open and map the file (it is kept mapped while the
+	 * images are read from it)
 	 ******************************************************/
-	QFile oFile(sFileName);
-	if (!oFile.open(QFile::ReadOnly))
+	QSharedPointer<QFile> pFile(new QFile(sFileName));
+	if (!pFile->open(QFile::ReadOnly))
     {
 		sMsgError = QString(QApplication::translate("FaceDataset", "it was not possible to read from file [%1]")).arg(sFileName);
         return false;
     }
 
-	// Used to resolve the image file names relative to the saved file path
-	QDir oBase(QFileInfo(sFileName).absolutePath());
+	quint64 iFileSize = pFile->size();
+	uchar *pData = iFileSize > 0 ? pFile->map(0, iFileSize) : NULL;
+	if(!pData)
+	{
+		sMsgError = QString(QApplication::translate("FaceDataset", "it was not possible to read from file [%1]")).arg(sFileName);
+		return false;
+	}
 
-	QTextStream oData(&oFile);
-	QString sData = oData.readAll();
-	oFile.close();
+	return loadFromBinaryData(pFile, pData, iFileSize, sMsgError);
+}
 
-	/******************************************************
-	 * Parse the xml document
-	 ******************************************************/
-	QDomDocument oDoc;
-	QString sError;
-	int iLine, iColumn;
-	if(!oDoc.setContent(sData, true, &sError, &iLine, &iColumn))
+// +-----------------------------------------------------------
+bool ft::FaceDataset::loadFromBinaryData(const QSharedPointer<QFile> &pFile, const uchar *pData, quint64 iFileSize, QString &sMsgError)
+{
+	QString sFileName = pFile->fileName();
+	if(iFileSize < FADB_V1_HEADER_SIZE)
 	{
-		sMsgError = QString(QApplication::translate("FaceDataset", "there is an error in the contents of the file [%1]: error [%2], line [%3], column [%4]")).arg(sFileName, sError, QString::number(iLine), QString::number(iColumn));
+		sMsgError = QString(QApplication::translate("FaceDataset", "the file [%1] is not a valid binary face annotation dataset")).arg(sFileName);
 		return false;
 	}
 
-	// Root node
-	QDomElement oRoot = oDoc.firstChildElement("FaceDataset");
+	/******************************************************
+	 * Validate the header and the sections
+	 ******************************************************/
+	// The header is copied, so the fields added after the version 1 are zero in the older files
+	FadbHeader oHeader;
+	memset(&oHeader, 0, sizeof(oHeader));
+	memcpy(&oHeader, pData, FADB_V1_HEADER_SIZE);
+	if(oHeader.iVersion > 1 && iFileSize >= sizeof(oHeader))
+		memcpy(&oHeader, pData, sizeof(oHeader));
 
-	if(oRoot.isNull())
+	if(memcmp(oHeader.aMagic, FADB_MAGIC, sizeof(FADB_MAGIC)) != 0 || oHeader.iByteOrder != FADB_BYTE_ORDER ||
+	   (oHeader.iVersion > 1 && iFileSize < sizeof(FadbHeader)))
 	{
-		sMsgError = QString(QApplication::translate("FaceDataset", "there is an error in the contents of the file [%1]: the node '%2' does not exist")).arg(sFileName, "FaceDataset");
+		sMsgError = QString(QApplication::translate("FaceDataset", "the file [%1] is not a valid binary face annotation dataset")).arg(sFileName);
 		return false;
 	}
 
-	int iNumFeats = oRoot.attribute("numberOfFeatures", "-1").toInt();
-	if(iNumFeats < 0)
+	if(oHeader.iVersion < 1 || oHeader.iVersion > FADB_VERSION || oHeader.iCoordinateFormat > FadbFixed16)
 	{
-		sMsgError = QString(QApplication::translate("FaceDataset", "there is an error in the contents of the file [%1]: the attribute '%2' does not exist or it contains an invalid value")).arg(sFileName, "numberOfFeatures");
+		sMsgError = QString(QApplication::translate("FaceDataset", "the file [%1] has an unsupported version [%2]")).arg(sFileName, QString::number(oHeader.iVersion));
 		return false;
 	}
 
-	// Sample images
-	QDomElement oSamples = oRoot.firstChildElement("Samples");
-	if(oSamples.isNull())
+	quint64 iNumSamples = oHeader.iNumSamples;
+	quint64 iNumFeats = oHeader.iNumFeatures;
+	bool bFixed = oHeader.iCoordinateFormat == FadbFixed16;
+	if(iNumFeats > (quint64) INT_MAX || iNumSamples > (quint64) INT_MAX ||
+	   !sectionFits(oHeader.iCoordinatesOffset, iNumSamples * iNumFeats, 2 * (bFixed ? sizeof(qint16) : sizeof(float)), iFileSize) ||
+	   !sectionFits(oHeader.iConnectionsOffset, oHeader.iNumConnections, 2 * sizeof(qint32), iFileSize) ||
+	   !sectionFits(oHeader.iPathDataOffset, oHeader.iPathDataSize, 1, iFileSize) ||
+	   !sectionFits(oHeader.iPathsOffset, iNumSamples, sizeof(FadbPath), iFileSize))
 	{
-		sMsgError = QString(QApplication::translate("FaceDataset", "there is an error in the contents of the file [%1]: the node '%2' does not exist")).arg(sFileName, "Samples");
+		sMsgError = QString(QApplication::translate("FaceDataset", "there is an error in the contents of the file [%1]: %2")).arg(sFileName, QApplication::translate("FaceDataset", "the sections do not match the file size"));
 		return false;
 	}
 
-	vector<FaceImage*> vSamples;
-	for(QDomElement oElement = oSamples.firstChildElement(); !oElement.isNull(); oElement = oElement.nextSiblingElement())
+	/******************************************************
+	 * Read the connections (the only data shared by all
+	 * the images)
+	 ******************************************************/
+	const qint32 *pConns = reinterpret_cast<const qint32*>(pData + oHeader.iConnectionsOffset);
+	FaceTopology oTopology;
+	for(quint64 j = 0; j < 2 * oHeader.iNumConnections; j++)
 	{
-		FaceImage *pSample = new FaceImage();
-		if(!pSample->loadFromXML(oElement, sError, iNumFeats))
+		if(pConns[j] < 0 || (quint64) pConns[j] >= iNumFeats)
 		{
-			foreach(FaceImage *pSamp, vSamples)
-				delete(pSamp);
-			delete pSample;
-
-			sMsgError = QString(QApplication::translate("FaceDataset", "there is an error in the contents of the file [%1]: %2")).arg(sFileName, sError);
+			sMsgError = QString(QApplication::translate("FaceDataset", "there is an error in the contents of the file [%1]: %2")).arg(sFileName, QApplication::translate("FaceDataset", "invalid connection [%1]").arg(j / 2));
 			return false;
 		}
-		pSample->setFileName(oBase.absoluteFilePath(pSample->fileName()));
+	}
+	for(quint64 j = 0; j < oHeader.iNumConnections; j++)
+		oTopology.connect(pConns[2 * j], pConns[2 * j + 1]);
+
+	/******************************************************
+	 * Create the samples. Their coordinates and file names
+	 * are only read from the data when they are needed, so
+	 * each sample only keeps the location of its entry in
+	 * the array of paths.
+	 ******************************************************/
+	FaceImagePool oPool;
+	oPool.reserve((int) iNumSamples);
+	vector<FaceImage*> vSamples;
+	vSamples.reserve(iNumSamples);
+	for(quint64 i = 0; i < iNumSamples; i++)
+	{
+		FaceImage *pSample = oPool.create();
+		pSample->setSource(oHeader.iPathsOffset + i * sizeof(FadbPath), sizeof(FadbPath), false);
 		vSamples.push_back(pSample);
 	}
 
 	clear();
-	m_iNumFeatures = iNumFeats;
+	m_iNumFeatures = (int) iNumFeats;
+	m_oTopology = oTopology;
+	m_oPool.merge(oPool);
 	m_vSamples = vSamples;
 
+	// A file saved in the compact mode is kept in that mode
+	m_bCompact = m_bCompact || bFixed;
+	setCompactCoordinates(m_bCompact);
+
+	if(!m_vSamples.empty())
+	{
+		m_pSource = pFile;
+		m_pSourceData = reinterpret_cast<const char*>(pData);
+		m_bBinarySource = true;
+		m_oBinaryLayout.iNumFeatures = (int) iNumFeats;
+		m_oBinaryLayout.bFixed = bFixed;
+		m_oBinaryLayout.iCoordinatesOffset = oHeader.iCoordinatesOffset;
+		m_oBinaryLayout.iPathDataOffset = oHeader.iPathDataOffset;
+		m_oBinaryLayout.iPathDataSize = oHeader.iPathDataSize;
+		m_oBinaryLayout.iPathsOffset = oHeader.iPathsOffset;
+
+		// Used to resolve the image file names relative to the saved file path
+		m_pSourcePaths = QSharedPointer<PathTable>(new PathTable(QDir(QFileInfo(sFileName).absolutePath())));
+	}
+
 	return true;
 }
 
 // +-----------------------------------------------------------
-bool ft::FaceDataset::saveToFile(const QString &sFileName, QString &sMsgError) const
+bool ft::FaceDataset::saveToBinaryFile(const QString &sFileName, QString &sMsgError) const
 {
 	/******************************************************
-	 * Create the xml document
+	 * Check that all samples fit in the fixed size arrays
+	 ******************************************************/
+	for(int i = 0; i < size(); i++)
+	{
+		if(m_vSamples[i]->numFeatures() != m_iNumFeatures)
+		{
+			sMsgError = QString(QApplication::translate("FaceDataset", "the image [%1] has %2 facial features, but the dataset has %3")).arg(m_vSamples[i]->fileName(), QString::number(m_vSamples[i]->numFeatures()), QString::number(m_iNumFeatures));
+			return false;
+		}
+	}
+
+	/******************************************************
+	 * Open the file
 	 ******************************************************/
-	QDomDocument oDoc;
+	QSaveFile oFile(sFileName);
+	if (!oFile.open(QFile::WriteOnly))
+    {
+		sMsgError = QString(QApplication::translate("FaceDataset", "it was not possible to write to file [%1]")).arg(sFileName);
+        return false;
+    }
 
-	// Processing instruction
-	QDomProcessingInstruction oInstr = oDoc.createProcessingInstruction("xml", "version='1.0' encoding='UTF-8'");
-	oDoc.appendChild(oInstr);
+	// Used to make the image file names relative to the saved file path
+	PathTable oPaths(QDir(QFileInfo(sFileName).absolutePath()));
 
-	// Root node
-	QDomElement oRoot = oDoc.createElementNS("https://github.com/luigivieira/Facial-Landmarks-Annotation-Tool", "FaceDataset");
-	oDoc.appendChild(oRoot);
+	// The header is completed at the end, which needs a seekable device, so
+	// the compressed files are written to memory and then compressed
+	bool bWritten;
+	if(isCompressedFile(sFileName))
+	{
+		QBuffer oBuffer;
+		GzipDevice oGzip(&oFile);
+		bWritten = oBuffer.open(QIODevice::ReadWrite) && writeBinaryData(&oBuffer, oPaths) && oGzip.open(QIODevice::WriteOnly);
+		if(bWritten)
+		{
+			oGzip.write(oBuffer.data());
+			oGzip.close();
+			bWritten = !oGzip.hasError();
+		}
+	}
+	else
+		bWritten = writeBinaryData(&oFile, oPaths);
 
-	oRoot.setAttribute("numberOfFeatures", m_iNumFeatures);
+	if(!bWritten || !oFile.commit())
+	{
+		sMsgError = QString(QApplication::translate("FaceDataset", "it was not possible to write to file [%1]")).arg(sFileName);
+		return false;
+	}
 
-	// Sample images
-	QDomElement oSamples = oDoc.createElement("Samples");
-	oRoot.appendChild(oSamples);
+	return true;
+}
 
-	// Used to make the image file names relative to the saved file path
-	QDir oBase(QFileInfo(sFileName).absolutePath());
-	QString sSave;
+// +-----------------------------------------------------------
+bool ft::FaceDataset::writeBinaryData(QIODevice *pDevice, PathTable &oPaths) const
+{
+	/******************************************************
+	 * Header
+	 ******************************************************/
+	FadbHeader oHeader;
+	memset(&oHeader, 0, sizeof(oHeader));
+	memcpy(oHeader.aMagic, FADB_MAGIC, sizeof(FADB_MAGIC));
+	oHeader.iVersion = FADB_VERSION;
+	oHeader.iByteOrder = FADB_BYTE_ORDER;
+	oHeader.iNumFeatures = m_iNumFeatures;
+	oHeader.iNumSamples = m_vSamples.size();
+
+	// The coordinates are saved in the compact mode only if all the images are stored in it
+	bool bFixed = m_bCompact;
+	for(int i = 0; i < size() && bFixed; i++)
+		bFixed = m_vSamples[i]->isCompact();
+	oHeader.iCoordinateFormat = bFixed ? FadbFixed16 : FadbFloat32;
 
+	// The header is written again at the end, when all offsets are known
+	pDevice->write(reinterpret_cast<const char*>(&oHeader), sizeof(oHeader));
+
+	/******************************************************
+	 * Coordinates
+	 ******************************************************/
+	alignTo8(pDevice);
+	oHeader.iCoordinatesOffset = pDevice->pos();
+	vector<float> vCoords(2 * m_iNumFeatures);
+	vector<qint16> vFixed(2 * m_iNumFeatures);
 	foreach(FaceImage *pImage, m_vSamples)
 	{
-		sSave = pImage->fileName(); // Save the absolute path (it is still used in the editor)
-		pImage->setFileName(oBase.relativeFilePath(pImage->fileName()));
-		pImage->saveToXML(oSamples);
-		pImage->setFileName(sSave);
+		if(!m_iNumFeatures)
+			break;
+
+		if(bFixed)
+		{
+			// The compact coordinates are multiples of the fixed-point step, so they are exact
+			for(int j = 0; j < m_iNumFeatures; j++)
+			{
+				vFixed[2 * j] = (qint16) qRound(pImage->x(j) * FaceImage::FIXED_POINT_SCALE);
+				vFixed[2 * j + 1] = (qint16) qRound(pImage->y(j) * FaceImage::FIXED_POINT_SCALE);
+			}
+			pDevice->write(reinterpret_cast<const char*>(vFixed.data()), vFixed.size() * sizeof(qint16));
+		}
+		else
+		{
+			const float *pX = pImage->xCoordinates();
+			const float *pY = pImage->yCoordinates();
+			for(int j = 0; j < m_iNumFeatures; j++)
+			{
+				vCoords[2 * j] = pX ? pX[j] : pImage->x(j);
+				vCoords[2 * j + 1] = pY ? pY[j] : pImage->y(j);
+			}
+			pDevice->write(reinterpret_cast<const char*>(vCoords.data()), vCoords.size() * sizeof(float));
+		}
 	}
 
 	/******************************************************
-	 * Save the file
+	 * Connections (the same in all images)
 	 ******************************************************/
-	QFile oFile(sFileName);
-	if (!oFile.open(QFile::WriteOnly | QFile::Truncate))
-    {
-		sMsgError = QString(QApplication::translate("FaceDataset", "it was not possible to write to file [%1]")).arg(sFileName);
-        return false;
-    }
+	alignTo8(pDevice);
+	oHeader.iConnectionsOffset = pDevice->pos();
+	const vector<pair<int, int> > &vConns = m_oTopology.connections();
+	for(int i = 0; i < (int) vConns.size(); i++)
+	{
+		qint32 aPair[2] = { vConns[i].first, vConns[i].second };
+		pDevice->write(reinterpret_cast<const char*>(aPair), sizeof(aPair));
+		oHeader.iNumConnections++;
+	}
 
-	QTextStream oData(&oFile);
-	oDoc.save(oData, 4);
-	oFile.close();
+	/******************************************************
+	 * Image paths
+	 ******************************************************/
+	alignTo8(pDevice);
+	oHeader.iPathDataOffset = pDevice->pos();
+	vector<FadbPath> vPaths(m_vSamples.size());
+	for(int i = 0; i < size(); i++)
+	{
+		QByteArray sPath = oPaths.relativeFilePath(m_vSamples[i]->directory(), m_vSamples[i]->baseName()).toUtf8();
+		vPaths[i].iOffset = pDevice->pos() - oHeader.iPathDataOffset;
+		vPaths[i].iLength = sPath.size();
+		pDevice->write(sPath);
+	}
+	oHeader.iPathDataSize = pDevice->pos() - oHeader.iPathDataOffset;
 
-	return true;
+	alignTo8(pDevice);
+	oHeader.iPathsOffset = pDevice->pos();
+	if(vPaths.size())
+		pDevice->write(reinterpret_cast<const char*>(vPaths.data()), vPaths.size() * sizeof(FadbPath));
+
+	/******************************************************
+	 * Complete the header
+	 ******************************************************/
+	return pDevice->seek(0) && pDevice->write(reinterpret_cast<const char*>(&oHeader), sizeof(oHeader)) == sizeof(oHeader);
 }
 
 // +-----------------------------------------------------------
 void ft::FaceDataset::clear()
 {
-	foreach(FaceImage *pImage, m_vSamples)
-		delete pImage;
+	// The memory of all the images is freed at once by the pool
+	m_oPool.clear(m_vSamples);
 	m_vSamples.clear();
+	m_oIndex.clear();
+	releaseSource();
 
 	m_iNumFeatures = 0;
+	m_oTopology.clear();
 }
 
 // +-----------------------------------------------------------
 ft::FaceImage* ft::FaceDataset::getImage(const int iIndex) const
+{
+	QString sMsgError;
+	return getImage(iIndex, sMsgError);
+}
+
+// +-----------------------------------------------------------
+ft::FaceImage* ft::FaceDataset::getImage(const int iIndex, QString &sMsgError) const
 {
     if(iIndex < 0 || iIndex >= size())
 		return NULL;
 
-	return m_vSamples[iIndex];
+	FaceImage *pImage = m_vSamples[iIndex];
+	if(!pImage->isLoaded() && !loadSample(pImage, sMsgError))
+		return NULL;
+	return pImage;
 }
 
 // +-----------------------------------------------------------
-ft::FaceImage* ft::FaceDataset::addImage(const QString &sFileName)
+QString ft::FaceDataset::imageFileName(const int iIndex) const
+{
+    if(iIndex < 0 || iIndex >= size())
+		return QString();
+
+	FaceImage *pImage = m_vSamples[iIndex];
+	resolveFileName(pImage);
+	return pImage->fileName();
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDataset::loadSample(FaceImage *pImage, QString &sMsgError) const
+{
+	// The image is left not loaded, so its node in the dataset file (if any) is
+	// kept as it is and it can not be saved with other data in its place
+	if(!m_pSourceData || !pImage->hasSource())
+	{
+		sMsgError = QString(QApplication::translate("FaceDataset", "the facial landmarks of the image [%1] can not be read, because the dataset file is no longer available")).arg(pImage->fileName());
+		return false;
+	}
+
+	if(m_bBinarySource)
+		return loadBinarySample(pImage, sMsgError);
+
+	QByteArray oData = QByteArray::fromRawData(m_pSourceData + pImage->sourceOffset(), pImage->sourceLength());
+
+	QString sError;
+	if(!pImage->loadFromXML(oData, QFileInfo(m_pSource->fileName()).absoluteDir(), sError, m_iNumFeatures))
+	{
+		sMsgError = QString(QApplication::translate("FaceDataset", "the facial landmarks of the image [%1] can not be read from the file [%2]: %3")).arg(pImage->fileName(), m_pSource->fileName(), sError);
+		return false;
+	}
+
+	if(m_bCompact)
+		pImage->setCompact(true);
+	return true;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDataset::loadBinarySample(FaceImage *pImage, QString &sMsgError) const
+{
+	if(!resolveFileName(pImage))
+	{
+		sMsgError = QString(QApplication::translate("FaceDataset", "there is an error in the contents of the file [%1]: %2")).arg(m_pSource->fileName(), QApplication::translate("FaceDataset", "invalid path of sample [%1]").arg((pImage->sourceOffset() - m_oBinaryLayout.iPathsOffset) / sizeof(FadbPath)));
+		return false;
+	}
+
+	// The coordinates are in the same order as the entries in the array of paths
+	// (and the whole section was checked to fit in the file when it was opened)
+	quint64 iSample = (pImage->sourceOffset() - m_oBinaryLayout.iPathsOffset) / sizeof(FadbPath);
+	quint64 iValues = 2 * iSample * m_oBinaryLayout.iNumFeatures;
+	const char *pCoords = m_pSourceData + m_oBinaryLayout.iCoordinatesOffset;
+	if(m_oBinaryLayout.bFixed)
+		pImage->setFixedFeatures(reinterpret_cast<const qint16*>(pCoords) + iValues, m_oBinaryLayout.iNumFeatures);
+	else
+		pImage->setFeatures(reinterpret_cast<const float*>(pCoords) + iValues, m_oBinaryLayout.iNumFeatures);
+	pImage->setCompact(m_bCompact);
+
+	// The image is as in the file, so it is not modified
+	pImage->setSource(pImage->sourceOffset(), pImage->sourceLength(), true);
+	pImage->setSaved(pImage->revision());
+	return true;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDataset::resolveFileName(FaceImage *pImage) const
+{
+	if(!m_bBinarySource || !pImage->hasSource() || !pImage->baseName().isEmpty())
+		return true;
+
+	const FadbPath *pPath = reinterpret_cast<const FadbPath*>(m_pSourceData + pImage->sourceOffset());
+	if(pPath->iOffset > m_oBinaryLayout.iPathDataSize || pPath->iLength > m_oBinaryLayout.iPathDataSize - pPath->iOffset)
+		return false;
+
+	int iDirectory;
+	QString sBaseName;
+	m_pSourcePaths->resolve(QString::fromUtf8(m_pSourceData + m_oBinaryLayout.iPathDataOffset + pPath->iOffset, (int) pPath->iLength), iDirectory, sBaseName);
+	pImage->setFileName(iDirectory, sBaseName);
+	return true;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDataset::loadAllSamples(QString &sMsgError)
+{
+	bool bRet = true;
+	foreach(FaceImage *pImage, m_vSamples)
+	{
+		QString sError;
+		if(!pImage->isLoaded() && !loadSample(pImage, sError) && bRet)
+		{
+			sMsgError = sError;
+			bRet = false;
+		}
+	}
+	return bRet;
+}
+
+// +-----------------------------------------------------------
+void ft::FaceDataset::releaseSource()
+{
+	// The file names not read yet would be lost with the source
+	foreach(FaceImage *pImage, m_vSamples)
+	{
+		resolveFileName(pImage);
+		pImage->setSource(-1, 0, pImage->isLoaded());
+	}
+
+	m_pSource.clear();
+	m_pSourceData = NULL;
+	m_iSourceVersion = 0;
+	m_bCoordinatesConverted = false;
+	m_bBinarySource = false;
+	m_oSourceBuffer.clear();
+	m_pSourcePaths.clear();
+}
+
+// +-----------------------------------------------------------
+void ft::FaceDataset::indexImages() const
 {
+	// Once built, the index is kept up to date as the images are added and removed
+	if(!m_oIndex.isEmpty() || m_vSamples.empty())
+		return;
+
+	m_oIndex.reserve(m_vSamples.size());
 	foreach(FaceImage *pImage, m_vSamples)
-		if(pImage->fileName() == sFileName)
-			return pImage;
+	{
+		resolveFileName(pImage);
+
+		// If a file is repeated in the dataset, its first image is the one indexed
+		QPair<int, QString> oKey(pImage->directory(), pImage->baseName());
+		if(!m_oIndex.contains(oKey))
+			m_oIndex.insert(oKey, pImage);
+	}
+}
+
+// +-----------------------------------------------------------
+void ft::FaceDataset::makeFeatureTemplate(FaceImage &oTemplate) const
+{
+	if(m_iNumFeatures == 0)
+		return;
+
+	// If the first image can not be read, the landmarks of the new ones are at the origin
+	const FaceImage *pFirst = m_vSamples.empty() ? NULL : getImage(0);
+	if(pFirst)
+		oTemplate.copyFeaturesFrom(pFirst);
+	else
+	{
+		vector<float> vPoints(2 * m_iNumFeatures, 0.0f);
+		oTemplate.setFeatures(vPoints.data(), m_iNumFeatures);
+	}
+	oTemplate.setCompact(m_bCompact);
+}
+
+// +-----------------------------------------------------------
+ft::FaceImage* ft::FaceDataset::addImage(const QString &sFileName)
+{
+	// The file names are compared by their directories in the path table
+	int iDirectory;
+	QString sBaseName;
+	PathTable::split(sFileName, iDirectory, sBaseName);
+
+	indexImages();
+	QPair<int, QString> oKey(iDirectory, sBaseName);
+	QHash<QPair<int, QString>, FaceImage*>::const_iterator it = m_oIndex.constFind(oKey);
+	if(it != m_oIndex.constEnd())
+		return it.value();
+
+	FaceImage oTemplate;
+	makeFeatureTemplate(oTemplate);
 
-	FaceImage *pRet = new FaceImage(sFileName);
+	FaceImage *pRet = m_oPool.create();
+	pRet->setFileName(iDirectory, sBaseName);
+	pRet->copyFeaturesFrom(&oTemplate);
 	m_vSamples.push_back(pRet);
+	m_oIndex.insert(oKey, pRet);
 	return pRet;
 }
 
+// +-----------------------------------------------------------
+int ft::FaceDataset::addImages(const QStringList &lFileNames)
+{
+	indexImages();
+	m_vSamples.reserve(m_vSamples.size() + lFileNames.size());
+	m_oIndex.reserve(m_oIndex.size() + lFileNames.size());
+	m_oPool.reserve(lFileNames.size());
+
+	// The coordinates of the template are shared by all the new images, so
+	// each image only costs a handle until it is edited
+	FaceImage oTemplate;
+	makeFeatureTemplate(oTemplate);
+
+	int iAdded = 0;
+	foreach(const QString &sFileName, lFileNames)
+	{
+		int iDirectory;
+		QString sBaseName;
+		PathTable::split(sFileName, iDirectory, sBaseName);
+
+		QPair<int, QString> oKey(iDirectory, sBaseName);
+		if(m_oIndex.contains(oKey))
+			continue;
+
+		FaceImage *pImage = m_oPool.create();
+		pImage->setFileName(iDirectory, sBaseName);
+		pImage->copyFeaturesFrom(&oTemplate);
+		m_vSamples.push_back(pImage);
+		m_oIndex.insert(oKey, pImage);
+		iAdded++;
+	}
+
+	return iAdded;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDataset::containsImage(const QString &sFileName) const
+{
+	int iDirectory;
+	QString sBaseName;
+	PathTable::split(sFileName, iDirectory, sBaseName);
+
+	indexImages();
+	return m_oIndex.contains(qMakePair(iDirectory, sBaseName));
+}
+
 // +-----------------------------------------------------------
 bool ft::FaceDataset::removeImage(const int iIndex)
 {
-	if(iIndex < 0 || iIndex >= size())
+	return removeImages(vector<int>(1, iIndex));
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDataset::removeImages(vector<int> vIndexes)
+{
+	sort(vIndexes.begin(), vIndexes.end());
+	vIndexes.erase(unique(vIndexes.begin(), vIndexes.end()), vIndexes.end());
+	if(vIndexes.empty())
+		return true;
+	if(vIndexes.front() < 0 || vIndexes.back() >= size())
 		return false;
 
-	FaceImage *pImage = m_vSamples[iIndex];
-	m_vSamples.erase(m_vSamples.begin() + iIndex);
-	delete pImage;
+	// The remaining images are moved to the front, in order
+	QSet<QPair<int, QString> > oUnindexed;
+	int iOut = 0;
+	int iNext = 0;
+	for(int i = 0; i < size(); i++)
+	{
+		FaceImage *pImage = m_vSamples[i];
+		if(iNext < (int) vIndexes.size() && vIndexes[iNext] == i)
+		{
+			iNext++;
+			QPair<int, QString> oKey(pImage->directory(), pImage->baseName());
+			QHash<QPair<int, QString>, FaceImage*>::iterator it = m_oIndex.find(oKey);
+			if(it != m_oIndex.end() && it.value() == pImage)
+			{
+				m_oIndex.erase(it);
+				oUnindexed.insert(oKey);
+			}
+			m_oPool.destroy(pImage);
+			continue;
+		}
+		m_vSamples[iOut++] = pImage;
+	}
+	m_vSamples.resize(iOut);
+
+	// If a file is repeated in the dataset, its first remaining image is indexed
+	// in place of the removed one
+	if(!oUnindexed.isEmpty())
+	{
+		foreach(FaceImage *pImage, m_vSamples)
+		{
+			QPair<int, QString> oKey(pImage->directory(), pImage->baseName());
+			if(oUnindexed.remove(oKey))
+				m_oIndex.insert(oKey, pImage);
+		}
+	}
 
 	return true;
 }
@@ -232,23 +1790,42 @@ void ft::FaceDataset::setNumFeatures(int iNumFeats)
 }
 
 // +-----------------------------------------------------------
-void ft::FaceDataset::addFeature(int iID, float x, float y)
+bool ft::FaceDataset::addFeature(float x, float y)
 {
-	FaceFeature *pFeat;
+	QString sMsgError;
+	if(!loadAllSamples(sMsgError))
+		return false;
+
 	foreach(FaceImage *pSample, m_vSamples)
-		pFeat = pSample->addFeature(iID, x, y);
+		pSample->addFeature(x, y);
 	m_iNumFeatures++;
+	return true;
 }
 
 // +-----------------------------------------------------------
 bool ft::FaceDataset::removeFeature(const int iIndex)
 {
-	if(iIndex < 0 || iIndex >= m_iNumFeatures)
+	return removeFeatures(vector<int>(1, iIndex));
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDataset::removeFeatures(vector<int> vIndexes)
+{
+	sort(vIndexes.begin(), vIndexes.end());
+	vIndexes.erase(unique(vIndexes.begin(), vIndexes.end()), vIndexes.end());
+	if(vIndexes.empty())
+		return true;
+	if(vIndexes.front() < 0 || vIndexes.back() >= m_iNumFeatures)
+		return false;
+
+	QString sMsgError;
+	if(!loadAllSamples(sMsgError))
 		return false;
 
 	foreach(FaceImage *pSample, m_vSamples)
-		pSample->removeFeature(iIndex);
-	m_iNumFeatures--;
+		pSample->removeFeatures(vIndexes);
+	m_oTopology.removeFeatures(vIndexes);
+	m_iNumFeatures -= (int) vIndexes.size();
 
 	return true;
 }
@@ -256,26 +1833,81 @@ bool ft::FaceDataset::removeFeature(const int iIndex)
 // +-----------------------------------------------------------
 bool ft::FaceDataset::connectFeatures(int iIDSource, int iIDTarget)
 {
-	foreach(FaceImage *pSample, m_vSamples)
-		pSample->connectFeatures(iIDSource, iIDTarget);
+	if(iIDSource < 0 || iIDSource >= m_iNumFeatures || iIDTarget < 0 || iIDTarget >= m_iNumFeatures)
+		return false;
 
+	m_oTopology.connect(iIDSource, iIDTarget);
 	return true;
 }
 
 // +-----------------------------------------------------------
 bool ft::FaceDataset::disconnectFeatures(int iIDSource, int iIDTarget)
 {
-	foreach(FaceImage *pSample, m_vSamples)
-		pSample->disconnectFeatures(iIDSource, iIDTarget);
+	if(iIDSource < 0 || iIDSource >= m_iNumFeatures || iIDTarget < 0 || iIDTarget >= m_iNumFeatures)
+		return false;
+
+	m_oTopology.disconnect(iIDSource, iIDTarget);
+	return true;
+}
+
+// +-----------------------------------------------------------
+const ft::FaceTopology & ft::FaceDataset::topology() const
+{
+	return m_oTopology;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDataset::getImageShape(const int iIndex, Shape &oShape) const
+{
+	oShape.pConnections = &m_oTopology.connections();
+
+	FaceImage *pImage = getImage(iIndex);
+	if(!pImage)
+	{
+		oShape.pX = NULL;
+		oShape.pY = NULL;
+		oShape.iNumFeatures = m_iNumFeatures;
+		return false;
+	}
 
+	oShape.iNumFeatures = pImage->numFeatures();
+	if(pImage->isCompact())
+	{
+		// The buffer keeps its capacity, so decoding the coordinates allocates nothing
+		m_vShapeBuffer.resize(2 * oShape.iNumFeatures);
+		for(int i = 0; i < oShape.iNumFeatures; i++)
+		{
+			m_vShapeBuffer[i] = pImage->x(i);
+			m_vShapeBuffer[oShape.iNumFeatures + i] = pImage->y(i);
+		}
+		oShape.pX = m_vShapeBuffer.data();
+		oShape.pY = m_vShapeBuffer.data() + oShape.iNumFeatures;
+	}
+	else
+	{
+		oShape.pX = pImage->xCoordinates();
+		oShape.pY = pImage->yCoordinates();
+	}
 	return true;
 }
 
 // +-----------------------------------------------------------
-vector<ft::FaceFeature*> ft::FaceDataset::getImageFeatures(const int iIndex)
+void ft::FaceDataset::setCompactCoordinates(bool bCompact)
 {
-	if(iIndex < 0 || iIndex >= (int) m_vSamples.size())
-		return vector<FaceFeature*>();
+	// The samples in the dataset file are then stored in another mode, so they
+	// can no longer be copied unchanged when the dataset is saved
+	if(bCompact != m_bCompact)
+		m_bCoordinatesConverted = true;
+	m_bCompact = bCompact;
+
+	// The images not loaded yet are converted when they are loaded
+	foreach(FaceImage *pImage, m_vSamples)
+		if(pImage->isLoaded())
+			pImage->setCompact(bCompact);
+}
 
-	return m_vSamples[iIndex]->getFeatures();
+// +-----------------------------------------------------------
+bool ft::FaceDataset::isCompactCoordinates() const
+{
+	return m_bCompact;
 }
\ No newline at end of file
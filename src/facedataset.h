@@ -21,9 +21,16 @@
 #define FACEDATASET_H
 
 #include "faceimage.h"
+#include "faceimagepool.h"
 #include "facefeature.h"
+#include "facetopology.h"
+#include "facedatasetsnapshot.h"
 
-#include <QDomDocument>
+#include <QFile>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QHash>
+#include <QPair>
 
 #include <vector>
 
@@ -36,6 +43,31 @@ namespace ft
 	class FaceDataset
 	{
 	public:
+		/** Version of the (xml) face annotation dataset format written by the application. */
+		static const int FILE_VERSION;
+
+		/**
+		 * View of the landmarks of one face image and of the connections among them (that are
+		 * the same in all images). Nothing is copied: the view points to the data of the dataset,
+		 * so it is only valid until the image or the dataset is changed. The coordinates of
+		 * an image stored in the compact mode are decoded into a buffer of the dataset, so the
+		 * view is then also only valid until the shape of another image is obtained.
+		 */
+		struct Shape
+		{
+			/** X coordinates of the landmarks (NULL if the image does not exist). */
+			const float *pX;
+
+			/** Y coordinates of the landmarks (NULL if the image does not exist). */
+			const float *pY;
+
+			/** Number of landmarks. */
+			int iNumFeatures;
+
+			/** Connections among the landmarks, as pairs of feature IDs (source, target). */
+			const std::vector<std::pair<int, int> > *pConnections;
+		};
+
 		/**
 		 * Class constructor.
 		 */
@@ -55,20 +87,51 @@ namespace ft
 		/**
 		 * Loads (unserializes) the instance from the given text file in the YAML format
 		 * (YAML Ain't Markup Language - http://en.wikipedia.org/wiki/YAML).
+		 * Files with the extension .fadb are read as binary face annotation datasets instead.
 		 * @param sFileName QString with the name of the file to read the data from.
 		 * @param sMsgError QString to receive the error message in case the method fails.
+		 * @param bLazy Boolean indicating if the samples should only be indexed (true), so each
+		 * one is parsed from the file when it is first accessed, or fully loaded (false). The
+		 * file is kept open (to read the samples not loaded and to copy the unchanged ones
+		 * when the dataset is saved). Binary datasets are always fully loaded.
 		 * @return Boolean indicating if the loading was successful (true) of failed (false).
 		 */
-		bool loadFromFile(const QString &sFileName, QString &sMsgError);
+		bool loadFromFile(const QString &sFileName, QString &sMsgError, bool bLazy = false);
 
         /**
          * Saves (serializes) the instance to the given file in the YAML format
 		 * (YAML Ain't Markup Language - http://en.wikipedia.org/wiki/YAML).
+		 * The data is streamed to a temporary file that atomically replaces the
+		 * given file on success. Samples that have not changed since they were read
+		 * from (or saved to) the dataset file are copied unchanged from it, so only
+		 * the changed samples are serialized. The samples are then read from the
+		 * saved file.
+		 * Files with the extension .fadb are written as binary face annotation datasets instead.
          * @param sFileName QString with the name of the file to write the data to.
 		 * @param sMsgError QString to receive the error message in case the method fails.
 		 * @return Boolean indicating if the saving was successful (true) of failed (false).
          */
-        bool saveToFile(const QString &sFileName, QString &sMsgError) const;
+        bool saveToFile(const QString &sFileName, QString &sMsgError);
+
+		/**
+		 * Creates a snapshot of the dataset to be saved to the given (xml) file. The snapshot
+		 * can then be written in another thread, while the dataset is still edited, as long as
+		 * images and features are not added or removed until the snapshot is committed.
+		 * @param sFileName QString with the name of the file to write the data to.
+		 * @return Pointer to the new FaceDatasetSnapshot (owned by the caller).
+		 */
+		FaceDatasetSnapshot* createSnapshot(const QString &sFileName) const;
+
+		/**
+		 * Commits the given snapshot after it has been written: the written file replaces the
+		 * existing one, and the samples are marked as saved in the revision of the snapshot
+		 * (so the ones changed since the snapshot was created remain modified).
+		 * @param pSnapshot Pointer to the FaceDatasetSnapshot written.
+		 * @param sMsgError QString to receive the error message in case the method fails
+		 * (including a failure to write the snapshot).
+		 * @return Boolean indicating if the saving was successful (true) of failed (false).
+		 */
+		bool commitSnapshot(FaceDatasetSnapshot *pSnapshot, QString &sMsgError);
 
         /**
          * Clear the face annotation dataset.
@@ -77,20 +140,56 @@ namespace ft
 
 		/**
 		 * Gets the face image for the given index. The index must be in the range [0, count - 1],
-		 * where count is the number of face images in the dataset.
+		 * where count is the number of face images in the dataset. If the image has not been
+		 * loaded yet (see loadFromFile), it is parsed from the dataset file.
 		 * @param iIndex Integer with the index of the image file to load.
-		 * @return Pointer to a FaceImage with the face image data. If the method fails, NULL is returned. 
+		 * @return Pointer to a FaceImage with the face image data. If the method fails (including
+		 * when the image data can not be parsed), NULL is returned.
 		 */
 		FaceImage* getImage(const int iIndex) const;
 
 		/**
-		 * Adds a new image to the face annotation dataset. All other data (landmarks, connections, etc)
-		 * are created with default values.
+		 * Gets the face image for the given index, as getImage(iIndex), also giving the reason
+		 * why the image data could not be parsed from the dataset file.
+		 * @param iIndex Integer with the index of the image file to load.
+		 * @param sMsgError QString to receive the error message in case the image data can not be parsed.
+		 * @return Pointer to a FaceImage with the face image data. If the method fails, NULL is returned.
+		 */
+		FaceImage* getImage(const int iIndex, QString &sMsgError) const;
+
+		/**
+		 * Gets the file name of the face image for the given index, without loading the image
+		 * data if it has not been loaded yet.
+		 * @param iIndex Integer with the index of the image.
+		 * @return QString with the complete file name of the image, or an empty string if the
+		 * index is out of range.
+		 */
+		QString imageFileName(const int iIndex) const;
+
+		/**
+		 * Adds a new image to the face annotation dataset. Its landmarks are shared with the first
+		 * image in the dataset (or are all at the origin, if there is none) until they are edited.
 		 * @param sFileName QString with the path and filename of the image file to be added to the dataset.
 		 * @return Pointer to a FaceImage with the new image added to the dataset or NULL if failed. 
 		 */
 		FaceImage* addImage(const QString &sFileName);
 
+		/**
+		 * Adds the given images to the face annotation dataset, at once. The images already in
+		 * the dataset (or repeated in the list) are ignored. The landmarks of the new images are
+		 * shared with the first image (as in addImage) until they are edited.
+		 * @param lFileNames QStringList with the paths and filenames of the image files to add.
+		 * @return Integer with the number of images added (at the end of the dataset).
+		 */
+		int addImages(const QStringList &lFileNames);
+
+		/**
+		 * Indicates if the given image is in the face annotation dataset.
+		 * @param sFileName QString with the path and filename of the image file.
+		 * @return Boolean indicating if the image is in the dataset (true) or not (false).
+		 */
+		bool containsImage(const QString &sFileName) const;
+
 		/**
 		 * Removes an image from the face annotation dataset. All other data (landmarks, connections, etc)
 		 * are also removed.
@@ -100,6 +199,15 @@ namespace ft
 		 */
 		bool removeImage(const int iIndex);
 
+		/**
+		 * Removes the given images from the face annotation dataset at once (the remaining
+		 * images are compacted in a single pass).
+		 * @param vIndexes Std vector with the indices of the images to remove (in any order).
+		 * @return Boolean indicating if the images were removed (true) or not (false, in case
+		 * any index is out of range, in which case nothing is removed).
+		 */
+		bool removeImages(std::vector<int> vIndexes);
+
 		/**
 		 * Queries the number of facial features in the dataset (applicable to all images).
 		 * @return Integer with the number of face features in the dataset.
@@ -114,12 +222,14 @@ namespace ft
 
 		/**
 		 * Adds a new feature to the face dataset. A new feature is added to all
-		 * face images in the dataset in the same coordinates.
-		 * @param iID Integer with the identifier of the face feature.
+		 * face images in the dataset in the same coordinates (after the existing
+		 * features, so its identifier is the previous number of features).
 		 * @param x Float with the x coordinate for the face features.
 		 * @param y Float with the y coordinate for the face features.
+		 * @return Boolean indicating if the feature was added (true) or not (false, if the
+		 * data of any image can not be parsed, in which case nothing is changed).
 		 */
-		void addFeature(int iID, float x = 0.0f, float y = 0.0f);
+		bool addFeature(float x = 0.0f, float y = 0.0f);
 
 		/**
 		 * Removes an existing feature from the face dataset. The feature is removed from all
@@ -130,36 +240,271 @@ namespace ft
 		bool removeFeature(const int iIndex);
 
 		/**
-		* Connects the two given features.
+		 * Removes the given features from the face dataset at once. The features are removed
+		 * from all face images in the dataset (each one is compacted in a single pass).
+		 * @param vIndexes Std vector with the indices of the features to remove (in any order).
+		 * @return Boolean indicating if the features were successfully removed (true) or not
+		 * (false, if any index is out of range or the data of any image can not be parsed,
+		 * in which case nothing is removed).
+		 */
+		bool removeFeatures(std::vector<int> vIndexes);
+
+		/**
+		 * Loads all the face images not loaded yet (see loadFromFile). The images whose data
+		 * can not be parsed are left not loaded, so they are never saved with other data in
+		 * place of their nodes in the dataset file.
+		 * @param sMsgError QString to receive the error message of the first image that can not be parsed.
+		 * @return Boolean indicating if all the images are loaded (true) or not (false).
+		 */
+		bool loadAllSamples(QString &sMsgError);
+
+		/**
+		* Connects the two given features (in all images, since the connections are stored
+		* once for the whole dataset).
 		* @param iIDSource Integer with the ID of the source feature.
 		* @param iIDTarget Integer with the ID of the target feature.
-		* @return Boolean indicating if the connection was successfully created.
+		* @return Boolean indicating if the connection was successfully created (false if
+		* any of the IDs is out of range).
 		*/
 		bool connectFeatures(int iIDSource, int iIDTarget);
 
 		/**
-		* Disconnects the two given features.
+		* Disconnects the two given features (in all images).
 		* @param iIDSource Integer with the ID of the source feature.
 		* @param iIDTarget Integer with the ID of the target feature.
-		* @return Boolean indicating if the connection was successfully removed.
+		* @return Boolean indicating if the connection was successfully removed (false if
+		* any of the IDs is out of range).
 		*/
 		bool disconnectFeatures(int iIDSource, int iIDTarget);
 
 		/**
-		 * Gets the list of face features in the given image index.
-		 * @param iIndex Integer with the index of the image to query the face features.
-		 * @param A vector of FaceFeature instances with the face features in the image. It returns
-		 * an empty vector if the given index is invalid.
+		 * Gets the connections among the face features, that are the same in all images.
+		 * @return Reference to the FaceTopology with the connections of the dataset.
+		 */
+		const FaceTopology & topology() const;
+
+		/**
+		 * Gets the landmarks of the given image and the connections among them, at once and
+		 * without copying them.
+		 * @param iIndex Integer with the index of the image.
+		 * @param oShape Shape to receive the view of the landmarks. If the index is invalid, the
+		 * coordinates are NULL, but the number of landmarks and the connections of the dataset
+		 * are still given.
+		 * @return Boolean indicating if the image exists (true) or not (false).
+		 */
+		bool getImageShape(const int iIndex, Shape &oShape) const;
+
+		/**
+		 * Changes the storage of the coordinates of all images in the dataset (including the
+		 * images loaded or added later). In the compact mode each coordinate is stored as a
+		 * 16 bits fixed-point value with a precision of 1/16 pixel (see FaceImage::setCompact),
+		 * which takes half the memory of the floats, and the binary dataset files are saved
+		 * in the same format. The images with coordinates out of the range of the fixed-point
+		 * values are kept with floats. Changing the mode changes the data of all the images,
+		 * so they are all written again in the next save (the images not loaded yet are
+		 * converted when they are loaded or saved).
+		 * @param bCompact Boolean indicating if the coordinates must be compact (true) or floats (false).
+		 */
+		void setCompactCoordinates(bool bCompact);
+
+		/**
+		 * Indicates if the coordinates of the images are stored in the compact mode.
+		 * @return Boolean indicating if the coordinates are compact (true) or floats (false).
 		 */
-		std::vector<FaceFeature*> getImageFeatures(const int iIndex);
+		bool isCompactCoordinates() const;
+
+		/**
+		 * Indicates if the given file name refers to a binary face annotation dataset
+		 * (i.e. if it has the extension .fadb, or .fadb.gz if it is compressed).
+		 * @param sFileName QString with the name of the file to check.
+		 * @return Boolean indicating if the file is a binary dataset (true) or not (false).
+		 */
+		static bool isBinaryFile(const QString &sFileName);
+
+		/**
+		 * Indicates if the given file name refers to a compressed face annotation dataset
+		 * (i.e. if it has the extension .gz, as in .fad.gz or .fadb.gz). The xml files are
+		 * (de)compressed as they stream from/to the disk, and the binary files are
+		 * (de)compressed in memory. When a compressed file is read, its format is
+		 * identified by the decompressed contents.
+		 * @param sFileName QString with the name of the file to check.
+		 * @return Boolean indicating if the file is compressed (true) or not (false).
+		 */
+		static bool isCompressedFile(const QString &sFileName);
+
+	protected:
+
+		/**
+		 * Loads the instance from the given binary face annotation dataset file. The file is
+		 * memory mapped and kept open, so the data of each image is read directly from the
+		 * mapped arrays (without any parsing) only when the image is needed.
+		 * @param sFileName QString with the name of the file to read the data from.
+		 * @param sMsgError QString to receive the error message in case the method fails.
+		 * @return Boolean indicating if the loading was successful (true) of failed (false).
+		 */
+		bool loadFromBinaryFile(const QString &sFileName, QString &sMsgError);
+
+		/**
+		 * Loads the instance from the given data in the binary face annotation dataset format
+		 * (the contents of a binary file, mapped or decompressed in memory). Only the header
+		 * and the connections are read: the data is then the source of the images, that are
+		 * read from it when needed (so it must remain valid until the source is released).
+		 * @param pFile Dataset file the data was read from.
+		 * @param pData Pointer to the data.
+		 * @param iFileSize Integer with the size of the data in bytes.
+		 * @param sMsgError QString to receive the error message in case the method fails.
+		 * @return Boolean indicating if the loading was successful (true) of failed (false).
+		 */
+		bool loadFromBinaryData(const QSharedPointer<QFile> &pFile, const uchar *pData, quint64 iFileSize, QString &sMsgError);
+
+		/**
+		 * Saves the instance to the given file in the binary face annotation dataset format.
+		 * The connections are stored once for the whole dataset (they are the same in all
+		 * images) and the coordinates are stored as single precision floats.
+		 * @param sFileName QString with the name of the file to write the data to.
+		 * @param sMsgError QString to receive the error message in case the method fails.
+		 * @return Boolean indicating if the saving was successful (true) of failed (false).
+		 */
+		bool saveToBinaryFile(const QString &sFileName, QString &sMsgError) const;
+
+		/**
+		 * Writes the instance to the given device in the binary face annotation dataset format.
+		 * @param pDevice Pointer to the (seekable) QIODevice to write the data to.
+		 * @param oPaths PathTable used to make the image file names relative to the file.
+		 * @return Boolean indicating if the writing was successful (true) of failed (false).
+		 */
+		bool writeBinaryData(QIODevice *pDevice, PathTable &oPaths) const;
+
+		/**
+		 * Parses the data of the given face image from the dataset file it was indexed from.
+		 * If the data can not be parsed (or the file is no longer available), the image is
+		 * left not loaded.
+		 * @param pImage Pointer to the FaceImage to load.
+		 * @param sMsgError QString to receive the error message in case the method fails.
+		 * @return Boolean indicating if the image was loaded (true) or not (false).
+		 */
+		bool loadSample(FaceImage *pImage, QString &sMsgError) const;
+
+		/**
+		 * Reads the coordinates of the given face image from the binary dataset file it was
+		 * created from (see loadSample).
+		 * @param pImage Pointer to the FaceImage to load.
+		 * @param sMsgError QString to receive the error message in case the method fails.
+		 * @return Boolean indicating if the image was loaded (true) or not (false).
+		 */
+		bool loadBinarySample(FaceImage *pImage, QString &sMsgError) const;
+
+		/**
+		 * Reads the file name of the given face image from the binary dataset file it was
+		 * created from, if it was not read yet (the images read from other sources always
+		 * have their file names).
+		 * @param pImage Pointer to the FaceImage to update.
+		 * @return Boolean indicating if the image has its file name (true) or if the file
+		 * name could not be read (false).
+		 */
+		bool resolveFileName(FaceImage *pImage) const;
+
+		/**
+		 * Opens and maps the given dataset file as the file from which the face images are read.
+		 * @param sFileName QString with the name of the file.
+		 * @return Boolean indicating if the file was opened (true) or not (false).
+		 */
+		bool openSource(const QString &sFileName);
+
+		/**
+		 * Releases the dataset file from which the face images are read.
+		 */
+		void releaseSource();
+
+		/**
+		 * Builds the index of the face images by their file names, if it is not built yet. The
+		 * index is only built when it is first needed, since it requires the file names of all
+		 * the images (that are only read when needed from the binary dataset files).
+		 */
+		void indexImages() const;
+
+		/**
+		 * Defines the landmarks of the new images added to the dataset in the given template
+		 * image: those of the first image in the dataset (or all at the origin, if there is none).
+		 * @param oTemplate FaceImage to receive the landmarks, that are then shared by the new images.
+		 */
+		void makeFeatureTemplate(FaceImage &oTemplate) const;
 
 	private:
 
 		/** Vector of sample face images. */
 		std::vector<FaceImage*> m_vSamples;
 
+		/** Pool from which the sample face images are allocated. */
+		FaceImagePool m_oPool;
+
+		/** Index of the sample face images by their file names (directory in the PathTable and base name). */
+		mutable QHash<QPair<int, QString>, FaceImage*> m_oIndex;
+
 		/** Number of face features in the dataset (i.e. applicable to all images). */
 		int m_iNumFeatures;
+
+		/** Connections among the face features (i.e. applicable to all images). */
+		FaceTopology m_oTopology;
+
+		/** Indication if the coordinates of the images are stored in the compact mode. */
+		bool m_bCompact;
+
+		/** Buffer to which the compact coordinates of an image are decoded by getImageShape. */
+		mutable std::vector<float> m_vShapeBuffer;
+
+		/** Dataset file from which the images were read (and the images not loaded yet are parsed). */
+		QSharedPointer<QFile> m_pSource;
+
+		/** Contents of the dataset file (mapped in memory). */
+		const char *m_pSourceData;
+
+		/** Version of the format of the dataset file. */
+		int m_iSourceVersion;
+
+		/** Layout of the sections of a binary dataset file (see loadFromBinaryData). */
+		struct BinaryLayout
+		{
+			/** Number of face features of each image in the file. */
+			int iNumFeatures;
+
+			/** Indication if the coordinates are stored in fixed point (true) or as floats (false). */
+			bool bFixed;
+
+			/** Offset in bytes of the coordinates of the first image. */
+			quint64 iCoordinatesOffset;
+
+			/** Offset in bytes of the UTF-8 data of the image paths. */
+			quint64 iPathDataOffset;
+
+			/** Size in bytes of the UTF-8 data of the image paths. */
+			quint64 iPathDataSize;
+
+			/** Offset in bytes of the array locating each image path in the path data. */
+			quint64 iPathsOffset;
+		};
+
+		/**
+		 * Indication if the dataset file is a binary one. Its images are then created with the
+		 * location of their entries in the array of paths as their source nodes, and both their
+		 * coordinates and file names are read when needed.
+		 */
+		bool m_bBinarySource;
+
+		/** Layout of the binary dataset file (if m_bBinarySource is true). */
+		BinaryLayout m_oBinaryLayout;
+
+		/** Decompressed contents of a compressed binary dataset file (to which m_pSourceData points). */
+		QByteArray m_oSourceBuffer;
+
+		/** PathTable used to resolve the file names read from the binary dataset file. */
+		QSharedPointer<PathTable> m_pSourcePaths;
+
+		/**
+		 * Indication if the storage mode of the coordinates changed since the dataset file was
+		 * read or saved (so all the samples must be written again, in the current mode).
+		 */
+		bool m_bCoordinatesConverted;
 	};
 }
 
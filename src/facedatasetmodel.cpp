@@ -19,22 +19,109 @@
  */
  
 #include "facedatasetmodel.h"
+#include "imagecache.h"
+#include "thumbnailcache.h"
 #include <assert.h>
 
 #include <QFileInfo>
+#include <QDir>
+#include <QSet>
 #include <QApplication>
+#include <QRunnable>
+#include <QImageReader>
 #include <QDebug>
 
+#include <algorithm>
+
+namespace
+{
+	/**
+	 * Maximum number of groups of consecutive rows removed with individual notifications.
+	 * Each group shifts the rows after it, so beyond this number the model is reset instead.
+	 */
+	const int MAX_REMOVED_RANGES = 32;
+
+	/** Width and height of the thumbnails, in pixels. */
+	const int THUMBNAIL_SIZE = 50;
+
+	/**
+	 * Memory budget of the thumbnails kept by each model, in KB (the thumbnails of the
+	 * rows no longer visible are evicted from the least recently displayed).
+	 */
+	const int THUMBNAIL_BUDGET = 16 * 1024;
+
+	/**
+	 * Number of full resolution images kept converted to pixmaps by each model (the images
+	 * themselves are kept by the ImageCache, so only the last ones displayed are kept here).
+	 */
+	const int PIXMAP_COUNT = 4;
+
+	/**
+	 * Task that builds the thumbnail of one image in the thread pool of the model, and
+	 * delivers it to the model in the GUI thread.
+	 */
+	class ThumbnailTask : public QRunnable
+	{
+	public:
+		/**
+		 * Class constructor.
+		 * @param pModel Instance of the FaceDatasetModel that receives the thumbnail.
+		 * @param sFileName QString with the complete file name of the image.
+		 * @param pCancelled Flag set by the model if the thumbnail is no longer needed.
+		 */
+		ThumbnailTask(ft::FaceDatasetModel *pModel, const QString &sFileName, const QSharedPointer<QAtomicInt> &pCancelled)
+		{
+			m_pModel = pModel;
+			m_sFileName = sFileName;
+			m_pCancelled = pCancelled;
+		}
+
+		/**
+		 * Builds the thumbnail and queues it to the model (unless it was cancelled while
+		 * the task was waiting in the queue).
+		 */
+		void run()
+		{
+			if(m_pCancelled->load())
+				return;
+
+			QImage oThumbnail = ft::FaceDatasetModel::buildThumbnail(m_sFileName);
+			QMetaObject::invokeMethod(m_pModel, "onThumbnailReady", Qt::QueuedConnection, Q_ARG(QString, m_sFileName), Q_ARG(QImage, oThumbnail));
+		}
+
+	private:
+		/** Model that receives the thumbnail. */
+		ft::FaceDatasetModel *m_pModel;
+
+		/** File name of the image. */
+		QString m_sFileName;
+
+		/** Flag set by the model if the thumbnail is no longer needed. */
+		QSharedPointer<QAtomicInt> m_pCancelled;
+	};
+}
+
 // +-----------------------------------------------------------
 ft::FaceDatasetModel::FaceDatasetModel(QObject *pParent):
 	QAbstractListModel(pParent)
 {
 	m_pFaceDataset = new FaceDataset();
+	m_bThumbnailsEnabled = true;
+	m_iFirstVisibleRow = -1;
+	m_iLastVisibleRow = -1;
+	m_oThumbnails.setMaxCost(THUMBNAIL_BUDGET);
+	m_oPixmaps.setMaxCost(PIXMAP_COUNT);
+
+	m_oPlaceholder = QPixmap(THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+	m_oPlaceholder.fill(Qt::transparent);
 }
 
 // +-----------------------------------------------------------
 ft::FaceDatasetModel::~FaceDatasetModel()
 {
+	// The tasks running refer to the model, so they must finish before it is destroyed
+	m_oThumbnailPool.clear();
+	m_oThumbnailPool.waitForDone();
 	delete m_pFaceDataset;
 }
 
@@ -88,8 +175,10 @@ QVariant ft::FaceDatasetModel::headerData(int iSection, Qt::Orientation eOrienta
 // +-----------------------------------------------------------
 QVariant ft::FaceDatasetModel::data(const QModelIndex &oIndex, int iRole) const
 {
-	FaceImage *pImage = m_pFaceDataset->getImage(oIndex.row());
-	if(!pImage)
+	// Only the file name is used, so the image data is not loaded if the
+	// dataset was opened lazily
+	QString sFileName = m_pFaceDataset->imageFileName(oIndex.row());
+	if(sFileName.isEmpty())
 		return QVariant();
 
 	QPixmap oPixmap;
@@ -101,19 +190,31 @@ QVariant ft::FaceDatasetModel::data(const QModelIndex &oIndex, int iRole) const
 			switch(oIndex.column())
 			{
 				case 0: // [Image Name]
-					return QFileInfo(pImage->fileName()).baseName();
+					return QFileInfo(sFileName).baseName();
 
 				case 1: // [File Path]
-					return pImage->fileName();
+					return sFileName;
 
 				default:
 					return QVariant();
 			}
 
-		// Decoration data (image thumbnails for the first column)
+		// Decoration data (image thumbnails for the first column). The views only query
+		// the rows they paint (the icons have a fixed size, so the layout does not query
+		// them), so the thumbnails are only built for those rows
 		case Qt::DecorationRole:
-			if(oIndex.column() == 0)
-				return m_lCachedThumbnails[oIndex.row()];
+			if(oIndex.column() != 0)
+				return QVariant();
+
+			if(m_bThumbnailsEnabled)
+			{
+				QPixmap *pThumbnail = m_oThumbnails.object(sFileName);
+				if(pThumbnail)
+					return *pThumbnail;
+
+				requestThumbnail(oIndex.row(), sFileName);
+				return m_oPlaceholder;
+			}
 			else
 				return QVariant();
 
@@ -122,12 +223,16 @@ QVariant ft::FaceDatasetModel::data(const QModelIndex &oIndex, int iRole) const
 			switch(oIndex.column())
 			{
 				case 0: // The complete image file name+path
-					return pImage->fileName();
+					return sFileName;
+
+				case 2: // The image data (converted once while it is among the last ones displayed)
+					if(m_oPixmaps.contains(sFileName))
+						return *m_oPixmaps.object(sFileName);
 
-				case 2: // The image data
-					oPixmap = pImage->pixMap();
+					oPixmap = QPixmap::fromImage(ImageCache::image(sFileName));
 					if(oPixmap.isNull())
-						oPixmap = QPixmap(":/images/brokenimage");
+						return QPixmap(":/images/brokenimage");
+					m_oPixmaps.insert(sFileName, new QPixmap(oPixmap));
 					return oPixmap;
 
 				default:
@@ -163,17 +268,19 @@ bool ft::FaceDatasetModel::setData(const QModelIndex &oIndex, const QVariant &oV
 }
 
 // +-----------------------------------------------------------
-bool ft::FaceDatasetModel::loadFromFile(const QString &sFileName, QString &sMsgError)
+bool ft::FaceDatasetModel::loadFromFile(const QString &sFileName, QString &sMsgError, bool bLazy)
 {
 	beginResetModel();
-	bool bRet = m_pFaceDataset->loadFromFile(sFileName, sMsgError);
+	bool bRet = m_pFaceDataset->loadFromFile(sFileName, sMsgError, bLazy);
 
-	// Rebuild the thumbnails cache
+	// The thumbnails of the previous images are not needed anymore
 	if(bRet)
 	{
-		m_lCachedThumbnails.clear();
-		for(int i = 0; i < m_pFaceDataset->size(); i++)
-			m_lCachedThumbnails.append(buildThumbnail(i));
+		cancelThumbnails();
+		m_oThumbnails.clear();
+		m_oPixmaps.clear();
+		m_iFirstVisibleRow = -1;
+		m_iLastVisibleRow = -1;
 	}
 
 	endResetModel();
@@ -189,43 +296,79 @@ bool ft::FaceDatasetModel::saveToFile(const QString &sFileName, QString &sMsgErr
 // +-----------------------------------------------------------
 bool ft::FaceDatasetModel::addImages(const QStringList &lImageFiles)
 {
-	// add images to list and build thumbnails
-	int iFirst = m_pFaceDataset->size();
-	int iLast = iFirst + lImageFiles.size() - 1;
-	beginInsertRows(QModelIndex(), iFirst, iLast);
-	for(int i = 0; i < lImageFiles.size(); i++)
+	// only the images not in the dataset yet are added (so the rows inserted are known in advance)
+	QStringList lNewFiles;
+	QSet<QString> oNew;
+	foreach(const QString &sFile, lImageFiles)
 	{
-		m_pFaceDataset->addImage(lImageFiles[i]);
-		m_lCachedThumbnails.append(buildThumbnail(m_pFaceDataset->size() - 1));
-	}
-	endInsertRows();
-	emit dataChanged(index(iFirst), index(iLast));
-	// ensure that all images have the same number of features (if we not just added the first image)
-	if (numFeatures() != 0 && iFirst > 0)
-	{
-		FaceImage * first_img = m_pFaceDataset->getImage(0);
-		for (int i = iFirst; i <= iLast; i++)
+		QString sPath = QDir::cleanPath(QDir::fromNativeSeparators(sFile));
+		if(!oNew.contains(sPath) && !m_pFaceDataset->containsImage(sPath))
 		{
-			FaceImage * new_img = m_pFaceDataset->getImage(i);
-			new_img->copyFeaturesFrom(first_img);
+			oNew.insert(sPath);
+			lNewFiles.append(sPath);
 		}
 	}
+	if(lNewFiles.isEmpty())
+		return true;
+
+	// add images to list and build thumbnails
+	int iFirst = m_pFaceDataset->size();
+	int iLast = iFirst + lNewFiles.size() - 1;
+	beginInsertRows(QModelIndex(), iFirst, iLast);
+	m_pFaceDataset->addImages(lNewFiles);
+	endInsertRows();
 	return true;
 }
 
 // +-----------------------------------------------------------
 bool ft::FaceDatasetModel::removeImages(const QList<int> &lImageIndexes)
 {
-	int iFirst = lImageIndexes.first();
-	int iLast = lImageIndexes.last();
-	beginRemoveRows(QModelIndex(), iFirst, iLast);
-	for(int i = lImageIndexes.size() - 1; i >= 0; i--)
+	// The selection can be in any order
+	std::vector<int> vIndexes(lImageIndexes.begin(), lImageIndexes.end());
+	std::sort(vIndexes.begin(), vIndexes.end());
+	vIndexes.erase(std::unique(vIndexes.begin(), vIndexes.end()), vIndexes.end());
+	if(vIndexes.empty())
+		return true;
+	if(vIndexes.front() < 0 || vIndexes.back() >= m_pFaceDataset->size())
+		return false;
+
+	// Groups of consecutive rows (first and last row of each group)
+	std::vector<std::pair<int, int> > vRanges;
+	for(int i = 0; i < (int) vIndexes.size(); i++)
+	{
+		if(vRanges.empty() || vIndexes[i] != vRanges.back().second + 1)
+			vRanges.push_back(std::make_pair(vIndexes[i], vIndexes[i]));
+		else
+			vRanges.back().second = vIndexes[i];
+	}
+
+	if((int) vRanges.size() <= MAX_REMOVED_RANGES)
+	{
+		// Each group is removed from the last one, so the rows of the groups
+		// before it are not changed
+		for(int i = (int) vRanges.size() - 1; i >= 0; i--)
+		{
+			int iFirst = vRanges[i].first;
+			int iLast = vRanges[i].second;
+			beginRemoveRows(QModelIndex(), iFirst, iLast);
+
+			std::vector<int> vRange;
+			for(int j = iFirst; j <= iLast; j++)
+				vRange.push_back(j);
+			m_pFaceDataset->removeImages(vRange);
+
+			endRemoveRows();
+		}
+	}
+	else
 	{
-		m_pFaceDataset->removeImage(lImageIndexes[i]);
-		m_lCachedThumbnails.removeAt(lImageIndexes[i]);
+		// Too scattered: all the rows are removed in a single pass
+		beginResetModel();
+
+		m_pFaceDataset->removeImages(vIndexes);
+		endResetModel();
 	}
-	endRemoveRows();
-	emit dataChanged(index(0), index(lImageIndexes.size() - 1));
+
 	return true;
 }
 
@@ -236,9 +379,9 @@ ft::FaceDataset * ft::FaceDatasetModel::getFaceDataset()
 }
 
 // +-----------------------------------------------------------
-void ft::FaceDatasetModel::addFeature(int iID, float x, float y)
+void ft::FaceDatasetModel::addFeature(float x, float y)
 {
-	m_pFaceDataset->addFeature(iID, x, y);
+	m_pFaceDataset->addFeature(x, y);
 }
 
 // +-----------------------------------------------------------
@@ -247,6 +390,12 @@ void ft::FaceDatasetModel::removeFeature(const int iIndex)
 	m_pFaceDataset->removeFeature(iIndex);
 }
 
+// +-----------------------------------------------------------
+void ft::FaceDatasetModel::removeFeatures(const std::vector<int> &vIndexes)
+{
+	m_pFaceDataset->removeFeatures(vIndexes);
+}
+
 // +-----------------------------------------------------------
 void ft::FaceDatasetModel::connectFeatures(int iIDSource, int iIDTarget)
 {
@@ -260,9 +409,9 @@ void ft::FaceDatasetModel::disconnectFeatures(int iIDSource, int iIDTarget)
 }
 
 // +-----------------------------------------------------------
-std::vector<ft::FaceFeature*> ft::FaceDatasetModel::getFeatures(const int iIndex)
+bool ft::FaceDatasetModel::getShape(const int iIndex, FaceDataset::Shape &oShape) const
 {
-	return m_pFaceDataset->getImageFeatures(iIndex);
+	return m_pFaceDataset->getImageShape(iIndex, oShape);
 }
 
 // +-----------------------------------------------------------
@@ -272,23 +421,148 @@ int ft::FaceDatasetModel::numFeatures() const
 }
 
 // +-----------------------------------------------------------
-QPixmap ft::FaceDatasetModel::buildThumbnail(const int iIndex)
+QImage ft::FaceDatasetModel::buildThumbnail(const QString &sFileName)
 {
-	QPixmap oImage;
-	FaceImage *pImage = m_pFaceDataset->getImage(iIndex);
-	if(!pImage)
-		oImage = QPixmap(":/images/imagemissing");
+	QImage oImage;
+	if(sFileName.isEmpty())
+		oImage = QImage(":/images/imagemissing");
 	else
 	{
-		oImage = pImage->pixMap();
-		if(oImage.isNull())
-			oImage = QPixmap(":/images/imagemissing");
+		// The thumbnails built before are read from the disk, without decoding the image
+		if(ThumbnailCache::find(sFileName, THUMBNAIL_SIZE, oImage))
+			return oImage;
+
+		// The image is decoded directly in the size of the thumbnail (keeping its aspect
+		// ratio), so the decoder can skip most of the data (e.g. JPEG downscales it while
+		// decoding) and the full resolution image is never in memory
+		QImageReader oReader(sFileName);
+		QSize oSize = oReader.size();
+		if(oSize.isValid())
+		{
+			oSize.scale(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio);
+			oReader.setScaledSize(oSize.expandedTo(QSize(1, 1)));
+		}
+
+		if(oReader.read(&oImage))
+		{
+			// Some formats do not support decoding in a smaller size
+			if(oImage.width() > THUMBNAIL_SIZE || oImage.height() > THUMBNAIL_SIZE)
+				oImage = oImage.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+			ThumbnailCache::store(sFileName, THUMBNAIL_SIZE, oImage);
+			return oImage;
+		}
+
+		oImage = QImage(":/images/imagemissing");
 	}
 
-	oImage = oImage.scaled(50, 50, Qt::IgnoreAspectRatio);
+	oImage = oImage.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio);
 	return oImage;
 }
 
+// +-----------------------------------------------------------
+void ft::FaceDatasetModel::setThumbnailsEnabled(bool bEnabled)
+{
+	if(bEnabled == m_bThumbnailsEnabled)
+		return;
+
+	m_bThumbnailsEnabled = bEnabled;
+	if(!bEnabled)
+	{
+		cancelThumbnails();
+		m_oThumbnails.clear();
+	}
+
+	// Only the rows displayed change
+	int iLast = qMin(m_iLastVisibleRow, rowCount() - 1);
+	if(m_iFirstVisibleRow >= 0 && m_iFirstVisibleRow <= iLast)
+		emit dataChanged(index(m_iFirstVisibleRow), index(iLast), QVector<int>() << Qt::DecorationRole);
+}
+
+// +-----------------------------------------------------------
+void ft::FaceDatasetModel::setVisibleRows(int iFirst, int iLast)
+{
+	m_iFirstVisibleRow = iFirst;
+	m_iLastVisibleRow = iLast;
+
+	// The thumbnails of the rows scrolled away are not built anymore (if they are
+	// displayed again, they are requested again)
+	QHash<QString, PendingThumbnail>::iterator it = m_oPendingThumbnails.begin();
+	while(it != m_oPendingThumbnails.end())
+	{
+		if(!isRowVisible(it.value().iRow))
+		{
+			it.value().pCancelled->store(1);
+			it = m_oPendingThumbnails.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDatasetModel::isRowVisible(int iRow) const
+{
+	// While the range is not known, all the rows requested are considered visible
+	return m_iFirstVisibleRow < 0 || (iRow >= m_iFirstVisibleRow && iRow <= m_iLastVisibleRow);
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDatasetModel::thumbnailsEnabled() const
+{
+	return m_bThumbnailsEnabled;
+}
+
+// +-----------------------------------------------------------
+void ft::FaceDatasetModel::requestThumbnail(int iRow, const QString &sFileName) const
+{
+	// If the thumbnail is already being built, it is delivered to the row that requested it last
+	QHash<QString, PendingThumbnail>::iterator it = m_oPendingThumbnails.find(sFileName);
+	if(it != m_oPendingThumbnails.end())
+	{
+		it.value().iRow = iRow;
+		return;
+	}
+
+	// The rows in the viewport are built first, from its top (the rows requested out of
+	// it, if any, are built only when there is nothing else to build)
+	int iPriority = 0;
+	if(m_iFirstVisibleRow >= 0 && isRowVisible(iRow))
+		iPriority = 1 + m_iLastVisibleRow - iRow;
+
+	PendingThumbnail oPending;
+	oPending.iRow = iRow;
+	oPending.pCancelled = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+	m_oPendingThumbnails.insert(sFileName, oPending);
+	m_oThumbnailPool.start(new ThumbnailTask(const_cast<FaceDatasetModel*>(this), sFileName, oPending.pCancelled), iPriority);
+}
+
+// +-----------------------------------------------------------
+void ft::FaceDatasetModel::cancelThumbnails()
+{
+	// The tasks already running can not be stopped, so their results are ignored
+	m_oThumbnailPool.clear();
+	m_oPendingThumbnails.clear();
+}
+
+// +-----------------------------------------------------------
+void ft::FaceDatasetModel::onThumbnailReady(const QString &sFileName, const QImage &oThumbnail)
+{
+	QHash<QString, PendingThumbnail>::iterator it = m_oPendingThumbnails.find(sFileName);
+	if(it == m_oPendingThumbnails.end())
+		return;
+	int iRow = it.value().iRow;
+	m_oPendingThumbnails.erase(it);
+
+	QPixmap *pThumbnail = new QPixmap(QPixmap::fromImage(oThumbnail));
+	m_oThumbnails.insert(sFileName, pThumbnail, qMax(1, pThumbnail->width() * pThumbnail->height() * pThumbnail->depth() / 8192));
+
+	// The rows might have changed since the thumbnail was requested. The views then
+	// query the rows they display again, so if the image is displayed it is requested
+	// for its new row (and there is no other row to update)
+	if(m_pFaceDataset->imageFileName(iRow) == sFileName)
+		emit dataChanged(index(iRow), index(iRow), QVector<int>() << Qt::DecorationRole);
+}
+
 // +-----------------------------------------------------------
 Qt::ItemFlags ft::FaceDatasetModel::flags(const QModelIndex &oIndex) const
 {
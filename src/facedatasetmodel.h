@@ -26,6 +26,12 @@
 #include <QAbstractListModel>
 #include <QList>
 #include <QPixmap>
+#include <QImage>
+#include <QThreadPool>
+#include <QCache>
+#include <QHash>
+#include <QSharedPointer>
+#include <QAtomicInt>
 
 namespace ft
 {
@@ -35,6 +41,8 @@ namespace ft
 	 */
 	class FaceDatasetModel : public QAbstractListModel
 	{
+		Q_OBJECT
+
 	public:
 		/**
 		 * Class constructor.
@@ -93,9 +101,11 @@ namespace ft
 		 * (YAML Ain't Markup Language - http://en.wikipedia.org/wiki/YAML).
 		 * @param sFileName QString with the name of the file to read the data from.
 		 * @param sMsgError QString to receive the error message in case the method fails.
+		 * @param bLazy Boolean indicating if the image samples should only be parsed when
+		 * first accessed (true) or all loaded at once (false). See FaceDataset::loadFromFile.
 		 * @return Boolean indicating if the loading was successful (true) of failed (false).
 		 */
-		bool loadFromFile(const QString &sFileName, QString &sMsgError);
+		bool loadFromFile(const QString &sFileName, QString &sMsgError, bool bLazy = false);
 
         /**
          * Saves the data to the given file in the YAML format
@@ -114,8 +124,10 @@ namespace ft
 		bool addImages(const QStringList &lImageFiles);
 
 		/**
-		 * Removes the given images to the dataset.
-		 * @param lImageFiles QList with the list of image indexes to remove.
+		 * Removes the given images from the dataset. The removal of each group of
+		 * consecutive rows is notified separately (or, if the rows are too scattered,
+		 * the model is reset).
+		 * @param lImageIndexes QList with the list of image indexes to remove (in any order).
 		 * @return Boolean indicating if the operation was successful or not.
 		 */
 		bool removeImages(const QList<int> &lImageIndexes);
@@ -128,12 +140,11 @@ namespace ft
 
 		/**
 		 * Adds a new feature to the face dataset. A new feature is added to all
-		 * face images in the dataset in the same coordinates.
-		 * @param iID Integer with the identifier of the face feature.
+		 * face images in the dataset in the same coordinates (after the existing features).
 		 * @param x Float with the x coordinate for the face features.
 		 * @param y Float with the y coordinate for the face features.
 		 */
-		void addFeature(int iID, float x = 0.0f, float y = 0.0f);
+		void addFeature(float x = 0.0f, float y = 0.0f);
 
 		/**
 		 * Removes the feature of given index in all face images.
@@ -141,6 +152,12 @@ namespace ft
 		 */
 		void removeFeature(const int iIndex);
 
+		/**
+		 * Removes the features of given indices in all face images, at once.
+		 * @param vIndexes Std vector with the indices of the features to remove.
+		 */
+		void removeFeatures(const std::vector<int> &vIndexes);
+
 		/**
 		 * Connects the two given features in the face dataset.
 		 * @param iIDSource Integer with the ID of the source feature.
@@ -156,11 +173,12 @@ namespace ft
 		void disconnectFeatures(int iIDSource, int iIDTarget);
 
 		/**
-		 * Gets all features in the given face image index.
+		 * Gets the landmarks of the given face image and their connections, without copying them.
 		 * @param iIndex Integer with the index of the face image to query.
-		 * @return Vector of FaceFeature instances with the face features in the image.
+		 * @param oShape FaceDataset::Shape to receive the view of the landmarks.
+		 * @return Boolean indicating if the face image exists (true) or not (false).
 		 */
-		std::vector<FaceFeature*> getFeatures(const int iIndex);
+		bool getShape(const int iIndex, FaceDataset::Shape &oShape) const;
 
 		/**
 		 * Queries the number of facial features in the dataset (applicable to all images).
@@ -168,15 +186,65 @@ namespace ft
 		 */
 		int numFeatures() const;
 
+		/**
+		 * Build a thumbnail for the given image file. This is called from the threads of the
+		 * thread pool, so it works with QImage (QPixmap can only be used in the GUI thread).
+		 * The thumbnail is read from the ThumbnailCache if it was built before (so the image
+		 * is not decoded), or else it is built and stored in the cache. The image is decoded
+		 * directly in the size of the thumbnail, keeping its aspect ratio.
+		 * @param sFileName QString with the complete file name of the image.
+		 * @return A QImage with the thumbmail. If the image could not be read,
+		 * a thumbnail of the 'image missing' is returned instead.
+		 */
+		static QImage buildThumbnail(const QString &sFileName);
+
+		/**
+		 * Enables or disables the thumbnails of the images (for instance, when they are not
+		 * displayed by the view). While disabled, no thumbnail is built or kept in memory.
+		 * @param bEnabled Boolean indicating if the thumbnails are enabled (true) or not (false).
+		 */
+		void setThumbnailsEnabled(bool bEnabled);
+
+		/**
+		 * Indicates if the thumbnails of the images are enabled.
+		 * @return Boolean indicating if the thumbnails are enabled (true) or not (false).
+		 */
+		bool thumbnailsEnabled() const;
+
+		/**
+		 * Defines the rows displayed in the viewport of the view of the thumbnails. Their
+		 * thumbnails are built before any other, and the thumbnails still waiting to be built
+		 * for the rows out of the range are dropped.
+		 * @param iFirst Integer with the first row displayed (or -1 if it is not known).
+		 * @param iLast Integer with the last row displayed (or -1 if it is not known).
+		 */
+		void setVisibleRows(int iFirst, int iLast);
+
+	protected slots:
+
+		/**
+		 * Receives a thumbnail built in the thread pool, keeps it in the cache and updates the
+		 * row that requested it last.
+		 * @param sFileName QString with the complete file name of the image.
+		 * @param oThumbnail QImage with the thumbnail.
+		 */
+		void onThumbnailReady(const QString &sFileName, const QImage &oThumbnail);
+
 	protected:
 
 		/**
-		 * Build a thumbnail for the given image index.
-		 * @param iIndex Integer with the index of the image to build the thumbnail for.
-		 * @return A QPixmap with the thumbmail. If the image could not be read,
-		 * a thumbnail of the 'image missing' is returned instead.
+		 * Requests the thumbnail of the given image to the thread pool (if it was not requested
+		 * yet). The row shows the placeholder until the thumbnail is ready.
+		 * @param iRow Integer with the row of the image.
+		 * @param sFileName QString with the complete file name of the image.
 		 */
-		QPixmap buildThumbnail(const int iIndex);
+		void requestThumbnail(int iRow, const QString &sFileName) const;
+
+		/**
+		 * Discards the thumbnails requested and not built yet (for instance, because the
+		 * dataset was replaced), so their results are ignored when they arrive.
+		 */
+		void cancelThumbnails();
 
 		/**
 		 * Queries the display/edit flags for the given index.
@@ -185,16 +253,59 @@ namespace ft
 		 */
 		Qt::ItemFlags flags(const QModelIndex &oIndex) const;
 
+		/**
+		 * Indicates if the given row is displayed in the viewport (see setVisibleRows).
+		 * @param iRow Integer with the row to check.
+		 * @return Boolean indicating if the row is displayed (true) or not (false).
+		 */
+		bool isRowVisible(int iRow) const;
+
 	private:
+		/**
+		 * Thumbnail being built in the thread pool.
+		 */
+		struct PendingThumbnail
+		{
+			/** Row that requested the thumbnail last. */
+			int iRow;
+
+			/** Flag that makes the task drop the thumbnail if it did not start yet. */
+			QSharedPointer<QAtomicInt> pCancelled;
+		};
+
 		/** Instance of the face annotation dataset for data access. */
 		FaceDataset *m_pFaceDataset;
 
 		/**
-		 * List of thumbnails for the existing images to improve access performance.
-		 * The thumbnails are related to the images in the facedataset according to their
-		 * indexed position.
+		 * Thumbnails of the images displayed recently, indexed by the image file names. The
+		 * cache is limited in memory (the least recently displayed are evicted), so the memory
+		 * used does not depend on the number of images in the dataset.
+		 */
+		mutable QCache<QString, QPixmap> m_oThumbnails;
+
+		/** Thumbnails being built, indexed by the file names of the images. */
+		mutable QHash<QString, PendingThumbnail> m_oPendingThumbnails;
+
+		/**
+		 * Pixmaps of the last full resolution images displayed, indexed by the image file
+		 * names (so switching among them does not convert the images again).
 		 */
-		QList<QPixmap> m_lCachedThumbnails;
+		mutable QCache<QString, QPixmap> m_oPixmaps;
+
+		/** Indication if the thumbnails are enabled. */
+		bool m_bThumbnailsEnabled;
+
+		/** First row displayed in the viewport of the view of the thumbnails, or -1. */
+		int m_iFirstVisibleRow;
+
+		/** Last row displayed in the viewport of the view of the thumbnails, or -1. */
+		int m_iLastVisibleRow;
+
+		/** Thumbnail displayed while the thumbnail of an image is being built. */
+		QPixmap m_oPlaceholder;
+
+		/** Threads in which the thumbnails are built. */
+		mutable QThreadPool m_oThumbnailPool;
 	};
 
 }
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "facedatasetsnapshot.h"
+#include "facedataset.h"
+#include "gzipdevice.h"
+
+#include <QFileInfo>
+#include <QDir>
+#include <QApplication>
+#include <QXmlStreamWriter>
+
+using namespace std;
+
+// +-----------------------------------------------------------
+ft::FaceDatasetSnapshot::FaceDatasetSnapshot(const QString &sFileName)
+{
+	m_sFileName = sFileName;
+	m_bCompressed = false;
+	m_iNumFeatures = 0;
+	m_bCompact = false;
+	m_pSourceData = NULL;
+	m_bWritten = false;
+	m_pFile = new QSaveFile(sFileName);
+}
+
+// +-----------------------------------------------------------
+ft::FaceDatasetSnapshot::~FaceDatasetSnapshot()
+{
+	foreach(const Sample &oSample, m_vSamples)
+		delete oSample.pImage;
+	delete m_pFile;
+}
+
+// +-----------------------------------------------------------
+QString ft::FaceDatasetSnapshot::fileName() const
+{
+	return m_sFileName;
+}
+
+// +-----------------------------------------------------------
+int ft::FaceDatasetSnapshot::size() const
+{
+	return m_vSamples.size();
+}
+
+// +-----------------------------------------------------------
+int ft::FaceDatasetSnapshot::progress() const
+{
+	if(m_vSamples.empty())
+		return 100;
+	return (int) ((qint64) m_iProgress.load() * 100 / m_vSamples.size());
+}
+
+// +-----------------------------------------------------------
+QString ft::FaceDatasetSnapshot::errorMessage() const
+{
+	return m_sMsgError;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDatasetSnapshot::write()
+{
+	// The file is always written complete (to a temporary file), so the dataset file is
+	// never left half written; only the changed samples are serialized, though
+	m_bWritten = writeFile();
+	return m_bWritten;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceDatasetSnapshot::writeFile()
+{
+	/******************************************************
+	 * Open the file. The data is written to a temporary
+	 * file that only replaces the existing one (if any)
+	 * when the snapshot is committed.
+	 ******************************************************/
+	if (!m_pFile->open(QFile::WriteOnly))
+    {
+		m_sMsgError = QString(QApplication::translate("FaceDataset", "it was not possible to write to file [%1]")).arg(m_sFileName);
+        return false;
+    }
+
+	// Compressed files are written through a compression stream (the
+	// offsets of the samples are then not used)
+	GzipDevice oGzip(m_pFile);
+	QIODevice *pDevice = m_pFile;
+	if(m_bCompressed)
+	{
+		if(!oGzip.open(QIODevice::WriteOnly))
+		{
+			m_sMsgError = QString(QApplication::translate("FaceDataset", "it was not possible to write to file [%1]")).arg(m_sFileName);
+			return false;
+		}
+		pDevice = &oGzip;
+	}
+
+	// Used to make the image file names relative to the saved file path
+	PathTable oPaths(QDir(QFileInfo(m_sFileName).absolutePath()));
+
+	/******************************************************
+	 * Write the xml document (directly to the file)
+	 ******************************************************/
+	QXmlStreamWriter oWriter(pDevice);
+	oWriter.setAutoFormatting(true);
+	oWriter.setAutoFormattingIndent(4);
+	oWriter.writeStartDocument();
+
+	// Root node
+	oWriter.writeStartElement("FaceDataset");
+	oWriter.writeDefaultNamespace("https://github.com/luigivieira/Facial-Landmarks-Annotation-Tool");
+	oWriter.writeAttribute("version", QString::number(FaceDataset::FILE_VERSION));
+	oWriter.writeAttribute("numberOfFeatures", QString::number(m_iNumFeatures));
+
+	// Connections (the same in all images)
+	m_oTopology.saveToXML(oWriter);
+
+	// Sample images. The writer is only used for the contents of each sample, so
+	// the unchanged nodes in the dataset file can be written directly to the file
+	// in between (with the same indentation the writer would use)
+	oWriter.writeStartElement("Samples");
+	for(int i = 0; i < size(); i++)
+	{
+		Sample &oSample = m_vSamples[i];
+		oWriter.writeCharacters(QString());
+		pDevice->write("\n        ");
+
+		oSample.iOffset = pDevice->pos();
+		if(oSample.bCopy)
+			pDevice->write(m_pSourceData + oSample.iSourceOffset, oSample.iSourceLength);
+		else
+		{
+			const FaceImage *pImage = sampleImage(oSample);
+			if(!pImage)
+				return false;
+			pImage->saveToXML(oWriter, oPaths);
+		}
+		oSample.iLength = pDevice->pos() - oSample.iOffset;
+
+		m_iProgress.store(i + 1);
+	}
+	if(!m_vSamples.empty())
+	{
+		oWriter.writeCharacters(QString());
+		pDevice->write("\n    ");
+	}
+	oWriter.writeEndElement();
+
+	oWriter.writeEndElement();
+	oWriter.writeEndDocument();
+	if(m_bCompressed)
+		oGzip.close();
+
+	if(oWriter.hasError() || oGzip.hasError() || m_pFile->error() != QFileDevice::NoError)
+	{
+		m_sMsgError = QString(QApplication::translate("FaceDataset", "it was not possible to write to file [%1]")).arg(m_sFileName);
+		return false;
+	}
+
+	return true;
+}
+
+// +-----------------------------------------------------------
+const ft::FaceImage* ft::FaceDatasetSnapshot::sampleImage(Sample &oSample)
+{
+	if(!oSample.bParse)
+		return oSample.pImage;
+
+	// The sample was not loaded in the dataset, so it is parsed from the
+	// dataset file (in the same way the dataset does). If that fails, the
+	// save fails, since there is no data to write in place of the sample
+	if(!m_pSourceData || oSample.iSourceOffset < 0)
+	{
+		m_sMsgError = QString(QApplication::translate("FaceDataset", "the facial landmarks of the image [%1] can not be read, because the dataset file is no longer available")).arg(oSample.pImage->fileName());
+		return NULL;
+	}
+
+	QByteArray oData = QByteArray::fromRawData(m_pSourceData + oSample.iSourceOffset, oSample.iSourceLength);
+
+	QString sError;
+	if(!oSample.pImage->loadFromXML(oData, QFileInfo(m_pSource->fileName()).absoluteDir(), sError, m_iNumFeatures))
+	{
+		m_sMsgError = QString(QApplication::translate("FaceDataset", "the facial landmarks of the image [%1] can not be read from the file [%2]: %3")).arg(oSample.pImage->fileName(), m_pSource->fileName(), sError);
+		return NULL;
+	}
+
+	// The coordinates are written as they would be stored in the dataset
+	oSample.pImage->setCompact(m_bCompact);
+	oSample.bParse = false;
+	return oSample.pImage;
+}
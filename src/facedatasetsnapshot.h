@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FACEDATASETSNAPSHOT_H
+#define FACEDATASETSNAPSHOT_H
+
+#include "faceimage.h"
+#include "facetopology.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QSharedPointer>
+#include <QAtomicInt>
+
+#include <vector>
+
+namespace ft
+{
+	class FaceDataset;
+
+	/**
+	 * Copy of the data of a face annotation dataset as it must be saved to a (xml) file. It is
+	 * created by the dataset (FaceDataset::createSnapshot) and, since it does not depend on the
+	 * dataset, it can be written in another thread while the dataset is still being edited.
+	 * Only the samples that must be serialized are copied; the unchanged ones are copied from
+	 * the dataset file when the snapshot is written. The written file only replaces the
+	 * existing one when the snapshot is committed by the dataset (FaceDataset::commitSnapshot).
+	 */
+	class FaceDatasetSnapshot
+	{
+		friend class FaceDataset;
+
+	public:
+		/**
+		 * Class destructor. If the snapshot was written but not committed, the written data
+		 * is discarded.
+		 */
+		virtual ~FaceDatasetSnapshot();
+
+		/**
+		 * Gets the name of the file to which the snapshot is written.
+		 * @return QString with the file name.
+		 */
+		QString fileName() const;
+
+		/**
+		 * Gets the number of face samples in the snapshot.
+		 * @return Integer with the number of face samples.
+		 */
+		int size() const;
+
+		/**
+		 * Writes the snapshot to its file. This is the only method that can be called from
+		 * a thread other than the one where the dataset is edited.
+		 * @return Boolean indicating if the writing was successful (true) or failed (false).
+		 */
+		bool write();
+
+		/**
+		 * Gets the progress of the writing, that can be queried (from any thread) while the
+		 * snapshot is being written.
+		 * @return Integer with the percentage of the samples already written.
+		 */
+		int progress() const;
+
+		/**
+		 * Gets the error message of the writing, in case it failed.
+		 * @return QString with the error message.
+		 */
+		QString errorMessage() const;
+
+	protected:
+
+		/**
+		 * Class constructor.
+		 * @param sFileName QString with the name of the file to which the snapshot is written.
+		 */
+		FaceDatasetSnapshot(const QString &sFileName);
+
+		/**
+		 * Writes the complete file (to a temporary file that replaces the existing one
+		 * only when the snapshot is committed).
+		 * @return Boolean indicating if the writing was successful (true) or failed (false).
+		 */
+		bool writeFile();
+
+	private:
+
+		/**
+		 * Data of one face sample in the snapshot.
+		 */
+		struct Sample
+		{
+			/** Copy of the image data to serialize (NULL if the node is copied unchanged). */
+			FaceImage *pImage;
+
+			/** Indication if the node in the dataset file is copied unchanged. */
+			bool bCopy;
+
+			/** Indication if the image data must yet be parsed from the dataset file. */
+			bool bParse;
+
+			/** Offset of the image node in the dataset file, or -1. */
+			qint64 iSourceOffset;
+
+			/** Size of the image node in the dataset file. */
+			qint64 iSourceLength;
+
+			/** Revision of the image data in the snapshot. */
+			unsigned int iRevision;
+
+			/** Offset of the image node in the written file. */
+			qint64 iOffset;
+
+			/** Size of the image node in the written file. */
+			qint64 iLength;
+		};
+
+		/**
+		 * Gets the image data to serialize for the given sample, parsing it from the
+		 * dataset file if needed.
+		 * @param oSample Reference to the sample.
+		 * @return Pointer to the FaceImage with the image data, or NULL if it can not be
+		 * parsed (the error message is then set).
+		 */
+		const FaceImage* sampleImage(Sample &oSample);
+
+		/** Name of the file to which the snapshot is written. */
+		QString m_sFileName;
+
+		/** Indication if the file is written compressed (in gzip format). */
+		bool m_bCompressed;
+
+		/** Number of face features in the dataset. */
+		int m_iNumFeatures;
+
+		/** Indication if the coordinates are stored in the compact mode in the dataset. */
+		bool m_bCompact;
+
+		/** Connections among the face features in the dataset. */
+		FaceTopology m_oTopology;
+
+		/** Face samples in the snapshot. */
+		std::vector<Sample> m_vSamples;
+
+		/** Dataset file from which the unchanged samples are copied (shared with the dataset). */
+		QSharedPointer<QFile> m_pSource;
+
+		/** Contents of the dataset file (mapped in memory). */
+		const char *m_pSourceData;
+
+		/** Indication if the snapshot was successfully written. */
+		bool m_bWritten;
+
+		/** Temporary file with the complete written file. */
+		QSaveFile *m_pFile;
+
+		/** Number of samples already written. */
+		QAtomicInt m_iProgress;
+
+		/** Error message of the writing. */
+		QString m_sMsgError;
+	};
+}
+
+#endif // FACEDATASETSNAPSHOT_H
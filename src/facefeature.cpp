@@ -19,7 +19,6 @@
 
 #include "facefeature.h"
 #include <QApplication>
-#include <algorithm>
 
 using namespace std;
 
@@ -48,108 +47,99 @@ void ft::FaceFeature::setID(int iID)
 }
 
 // +-----------------------------------------------------------
-void ft::FaceFeature::connectTo(FaceFeature *pOther)
+bool ft::FaceFeature::loadFromXML(QXmlStreamReader &oReader, QString &sMsgError, vector<int> *pConnections)
 {
-	vector<int>::iterator it = find(m_vConnections.begin(), m_vConnections.end(), pOther->getID());
-	if (it == m_vConnections.end())
-		m_vConnections.push_back(pOther->getID());
-}
-
-// +-----------------------------------------------------------
-void ft::FaceFeature::disconnectFrom(FaceFeature *pOther)
-{
-	vector<int>::iterator it = find(m_vConnections.begin(), m_vConnections.end(), pOther->getID());
-	if (it != m_vConnections.end())
-		m_vConnections.erase(it);
-}
-
-// +-----------------------------------------------------------
-std::vector<int> ft::FaceFeature::getConnections()
-{
-	return m_vConnections;
-}
-
-// +-----------------------------------------------------------
-bool ft::FaceFeature::loadFromXML(const QDomElement &oElement, QString &sMsgError)
-{
-// Check the element name
-	if(oElement.tagName() != "Feature")
+	// Check the element name
+	if(oReader.name() != "Feature")
 	{
-		sMsgError = QString(QApplication::translate("FaceFeature", "invalid node name [%1] - expected node '%2'").arg(oElement.tagName(), "Feature"));
+		sMsgError = QString(QApplication::translate("FaceFeature", "invalid node name [%1] - expected node '%2'").arg(oReader.name().toString(), "Feature"));
 		return false;
 	}
 
-	QString sID = oElement.attribute("id");
-	if(sID == "")
+	// The attribute values are converted right away, so no string is kept
+	// beyond the reading of the start element
+	QXmlStreamAttributes oAttributes = oReader.attributes();
+
+	QStringRef sID = oAttributes.value("id");
+	if(sID.isEmpty())
 	{
 		sMsgError = QString(QApplication::translate("FaceFeature", "the attribute '%1' does not exist or it contains an invalid value").arg("id"));
 		return false;
 	}
 
-	QString sValueX = oElement.attribute("x");
-	if(sValueX == "")
+	QStringRef sValueX = oAttributes.value("x");
+	if(sValueX.isEmpty())
 	{
 		sMsgError = QString(QApplication::translate("FaceFeature", "the attribute '%1' does not exist or it contains an invalid value").arg("x"));
 		return false;
 	}
 
-	QString sValueY = oElement.attribute("y");
-	if(sValueY == "")
+	QStringRef sValueY = oAttributes.value("y");
+	if(sValueY.isEmpty())
 	{
 		sMsgError = QString(QApplication::translate("FaceFeature", "the attribute '%1' does not exist or it contains an invalid value").arg("y"));
 		return false;
 	}
 
-	// Connetions
-	QDomElement oConnections = oElement.firstChildElement("Connections");
-	if (oConnections.isNull())
-	{
-		sMsgError = QString(QApplication::translate("FaceFeature", "the node '%1' does not exist")).arg("Connections");
-		return false;
-	}
+	int iID = sID.toInt();
+	float fX = sValueX.toFloat();
+	float fY = sValueY.toFloat();
 
+	// Connetions (only in the old versions of the file, since they are now
+	// stored once for the whole dataset)
+	bool bConnections = false;
 	vector<int> vConnections;
-	for (QDomElement oConn = oConnections.firstChildElement(); !oConn.isNull(); oConn = oConn.nextSiblingElement())
+	while(oReader.readNextStartElement())
 	{
-		QString sValue = oConn.attribute("id");
-		if (sValue == "")
+		if(!pConnections || oReader.name() != "Connections" || bConnections)
 		{
-			sMsgError = QString(QApplication::translate("FaceFeature", "the attribute '%1' does not exist or it contains an invalid value").arg("id"));
-			return false;
+			oReader.skipCurrentElement();
+			continue;
 		}
 
-		vConnections.push_back(sValue.toInt());
+		bConnections = true;
+		while(oReader.readNextStartElement())
+		{
+			QXmlStreamAttributes oTarget = oReader.attributes();
+			QStringRef sValue = oTarget.value("id");
+			if(sValue.isEmpty())
+			{
+				sMsgError = QString(QApplication::translate("FaceFeature", "the attribute '%1' does not exist or it contains an invalid value").arg("id"));
+				return false;
+			}
+
+			vConnections.push_back(sValue.toInt());
+			oReader.skipCurrentElement();
+		}
 	}
 
-	m_iID = sID.toInt();
-	setX(sValueX.toFloat());
-	setY(sValueY.toFloat());
-	m_vConnections = vConnections;
-	
+	if(oReader.hasError())
+		return false;
+
+	if(pConnections && !bConnections)
+	{
+		sMsgError = QString(QApplication::translate("FaceFeature", "the node '%1' does not exist")).arg("Connections");
+		return false;
+	}
+
+	m_iID = iID;
+	setX(fX);
+	setY(fY);
+	if(pConnections)
+		pConnections->swap(vConnections);
+
 	return true;
 }
 
 // +-----------------------------------------------------------
-void ft::FaceFeature::saveToXML(QDomElement &oParent) const
+void ft::FaceFeature::saveToXML(QXmlStreamWriter &oWriter) const
 {
-	QDomElement oFeature = oParent.ownerDocument().createElement("Feature");
-	oParent.appendChild(oFeature);
+	oWriter.writeStartElement("Feature");
 
 	// Save the feature attributes
-	oFeature.setAttribute("id", m_iID);
-	oFeature.setAttribute("x", x());
-	oFeature.setAttribute("y", y());
+	oWriter.writeAttribute("id", QString::number(m_iID));
+	oWriter.writeAttribute("x", QString::number(x(), 'g', 16));
+	oWriter.writeAttribute("y", QString::number(y(), 'g', 16));
 
-	// Add the "Connections" subnode
-	QDomElement oConnections = oParent.ownerDocument().createElement("Connections");
-	oFeature.appendChild(oConnections);
-
-	// Save all the connections
-	QDomElement oTarget;
-	foreach(int iID, m_vConnections)
-	{
-		oTarget = oParent.ownerDocument().createElement("Target");
-		oConnections.appendChild(oTarget);
-		oTarget.setAttribute("id", iID);
-	}
+	oWriter.writeEndElement();
 }
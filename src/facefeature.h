@@ -20,14 +20,17 @@
 #ifndef FACE_FEATURE_H
 #define FACE_FEATURE_H
 
-#include <QDomDocument>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
 #include <vector>
 #include <QPoint>
 
 namespace ft
 {
 	/**
-	 * Represents the data of a facial feature in the image dataset.
+	 * Represents the data of a facial feature in the image dataset. The images store the
+	 * coordinates of all their features in contiguous arrays, so instances of this class
+	 * are copies of the data of one feature (identified by its index in the image).
 	 */
 	class FaceFeature : public QPointF
     {
@@ -59,44 +62,29 @@ namespace ft
 		void setID(int iID);
 
 		/**
-		 * Connects this feature to the feature of given ID.
-		 * @param *pOther Pointer to the other feature to connect to.
-		 */
-		void connectTo(FaceFeature *pOther);
-
-		/**
-		* Disconnects this feature from the feature of given ID.
-		* @param pOther Pointer to the other feature to disconnect from.
-		*/
-		void disconnectFrom(FaceFeature *pOther);
-
-		/**
-		 * Gets the list of features (by their IDs) to which this feature is connected to.
-		 * @return Std vector with a list of integers (the connected features' IDs).
-		 */
-		std::vector<int> getConnections();
-
-		/**
-		 * Loads (unserializes) the face feature data from the given xml element.
-		 * @param oElement QDomElement from where to read the feature data (the feature node in the xml).
-		 * @param sMsgError QString to receive the error message in case the method fails.
+		 * Loads (unserializes) the face feature data from the given xml stream. The reader must be
+		 * positioned at the start of the feature node, and it is left at the end of that node.
+		 * @param oReader QXmlStreamReader from where to read the feature data (the feature node in the xml).
+		 * @param sMsgError QString to receive the error message in case the method fails. It is not
+		 * changed if the failure is an xml syntax error (that is reported by the reader itself).
+		 * @param pConnections Pointer to a std vector to receive the IDs of the features to which this
+		 * feature is connected, as stored in the feature node by the old versions of the dataset file
+		 * (where the node is then required). If it is NULL (the default), the connections are ignored.
 		 * @return Boolean indicating if the loading was successful (true) or if it failed (false).
 		 */
-		bool loadFromXML(const QDomElement &oElement, QString &sMsgError);
+		bool loadFromXML(QXmlStreamReader &oReader, QString &sMsgError, std::vector<int> *pConnections = NULL);
 
         /**
-         * Saves the face feature data into the given xml element.
-		 * @param oParent QDomElement to receive the node of the face feature data.
+         * Saves the face feature data into the given xml stream, as a new feature node
+		 * inside the node currently open in the writer.
+		 * @param oWriter QXmlStreamWriter to receive the node of the face feature data.
          */
-        void saveToXML(QDomElement &oParent) const;
+        void saveToXML(QXmlStreamWriter &oWriter) const;
 
 	private:
 
 		/** Identifier of the face feature. */
 		int m_iID;
-
-		/** List of other features to which this feature is connected to. */
-		std::vector<int> m_vConnections;
     };
 }
 
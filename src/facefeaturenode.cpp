@@ -151,7 +151,7 @@ QVariant ft::FaceFeatureNode::itemChange(GraphicsItemChange eChange, const QVari
 			sText = QApplication::translate("FaceFeatureNode", "Node: %1 Position: (%2, %3)").arg(m_iID).arg(QString::number(pos().x(), 'f', 2)).arg(QString::number(pos().y(), 'f', 2));
 			FtApplication::instance()->showStatusMessage(sText, 0);
 
-			if(!data(0).toBool()) // This flag is used in ChildWindow::refreshFeaturesInWidget
+			if(!data(0).toBool()) // This flag is used in FaceWidget::setFaceFeatures
 				m_pFaceWidget->faceFeatureMoved(this);
 			break;
 	
@@ -19,6 +19,7 @@
  */
 
 #include "faceimage.h"
+#include "imagecache.h"
 
 #include <QApplication>
 #include <QFileInfo>
@@ -27,10 +28,71 @@
 
 using namespace std;
 
+// Steps per pixel of the fixed-point coordinates (a precision of 1/16 pixel)
+const int ft::FaceImage::FIXED_POINT_SCALE = 16;
+
+namespace
+{
+	/**
+	 * Converts a coordinate to the fixed-point value used in the compact mode.
+	 * @param fValue Float with the coordinate to convert.
+	 * @param iValue Integer to receive the fixed-point value.
+	 * @return Boolean indicating if the coordinate fits in the fixed-point value (true) or
+	 * not (false, also if it is not a number).
+	 */
+	bool toFixed(float fValue, qint16 &iValue)
+	{
+		float fScaled = fValue * ft::FaceImage::FIXED_POINT_SCALE;
+		if(!(fScaled >= -32768.0f && fScaled <= 32767.0f))
+			return false;
+		iValue = (qint16) qRound(fScaled);
+		return true;
+	}
+
+	/**
+	 * Removes the coordinates of the given features, moving the x coordinates and then
+	 * the y coordinates of the remaining features to the front (the position written
+	 * never passes the position read).
+	 * @param vCoords QVector with the x coordinates of all features, then their y coordinates.
+	 * @param iNumFeats Integer with the number of features in the vector.
+	 * @param vIndexes Std vector with the indices of the features to remove, in ascending
+	 * order and without repetitions.
+	 */
+	template<typename T>
+	void removeIndexes(QVector<T> &vCoords, int iNumFeats, const vector<int> &vIndexes)
+	{
+		T *pData = vCoords.data();
+		int iOut = 0;
+		for(int iPart = 0; iPart < 2; iPart++)
+		{
+			const T *pIn = pData + iPart * iNumFeats;
+			int iNext = 0;
+			for(int i = 0; i < iNumFeats; i++)
+			{
+				if(iNext < (int) vIndexes.size() && vIndexes[iNext] == i)
+				{
+					iNext++;
+					continue;
+				}
+				pData[iOut++] = pIn[i];
+			}
+		}
+		vCoords.resize(iOut);
+	}
+}
+
 // +-----------------------------------------------------------
 ft::FaceImage::FaceImage(const QString &sFileName)
 {
-	m_sFileName = sFileName;
+	m_bCompact = false;
+	PathTable::split(sFileName, m_iDirectory, m_sBaseName);
+	m_iSourceOffset = -1;
+	m_iSourceLength = 0;
+	m_bLoaded = true;
+	m_iRevision = 0;
+	m_iSavedRevision = 0;
+	m_iPtsRevision = 0;
+	m_bPtsSaved = false;
 }
 
 // +-----------------------------------------------------------
@@ -42,45 +104,119 @@ ft::FaceImage::~FaceImage()
 // +-----------------------------------------------------------
 void ft::FaceImage::copyFeaturesFrom(const FaceImage * oImg)
 {
-	m_vFeatures.clear();
-	for each (FaceFeature * src_ff in oImg->m_vFeatures)
-	{
-		m_vFeatures.push_back(new FaceFeature(*src_ff));
-	}
+	m_vCoords = oImg->m_vCoords;
+	m_vFixed = oImg->m_vFixed;
+	m_bCompact = oImg->m_bCompact;
+	setModified();
 }
 
 // +-----------------------------------------------------------
 void ft::FaceImage::clear()
 {
-	foreach(FaceFeature *pFeature, m_vFeatures)
-		delete pFeature;
-	m_vFeatures.clear();
+	m_vCoords.clear();
+	m_vFixed.clear();
+	m_bCompact = false;
 }
 
 // +-----------------------------------------------------------
 QString ft::FaceImage::fileName() const
 {
-	return m_sFileName;
+	return PathTable::filePath(m_iDirectory, m_sBaseName);
 }
 
 // +-----------------------------------------------------------
 void ft::FaceImage::setFileName(QString sFileName)
 {
-	m_sFileName = sFileName;
+	PathTable::split(sFileName, m_iDirectory, m_sBaseName);
+}
+
+// +-----------------------------------------------------------
+void ft::FaceImage::setFileName(int iDirectory, const QString &sBaseName)
+{
+	m_iDirectory = iDirectory;
+	m_sBaseName = sBaseName;
+}
+
+// +-----------------------------------------------------------
+int ft::FaceImage::directory() const
+{
+	return m_iDirectory;
+}
+
+// +-----------------------------------------------------------
+QString ft::FaceImage::baseName() const
+{
+	return m_sBaseName;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceImage::isLoaded() const
+{
+	return m_bLoaded;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceImage::hasSource() const
+{
+	return m_iSourceOffset >= 0;
+}
+
+// +-----------------------------------------------------------
+qint64 ft::FaceImage::sourceOffset() const
+{
+	return m_iSourceOffset;
+}
+
+// +-----------------------------------------------------------
+qint64 ft::FaceImage::sourceLength() const
+{
+	return m_iSourceLength;
+}
+
+// +-----------------------------------------------------------
+void ft::FaceImage::setSource(qint64 iOffset, qint64 iLength, bool bLoaded)
+{
+	m_iSourceOffset = iOffset < 0 ? -1 : iOffset;
+	m_iSourceLength = iOffset < 0 ? 0 : iLength;
+	m_bLoaded = bLoaded;
+}
+
+// +-----------------------------------------------------------
+void ft::FaceImage::setModified()
+{
+	m_iRevision++;
+}
+
+// +-----------------------------------------------------------
+unsigned int ft::FaceImage::revision() const
+{
+	return m_iRevision;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceImage::isModified() const
+{
+	return m_iRevision != m_iSavedRevision;
+}
+
+// +-----------------------------------------------------------
+void ft::FaceImage::setSaved(unsigned int iRevision)
+{
+	m_iSavedRevision = iRevision;
 }
 
 // +-----------------------------------------------------------
-bool ft::FaceImage::loadFromXML(const QDomElement &oElement, QString &sMsgError, int iNumExpectedFeatures)
+bool ft::FaceImage::loadFromXML(QXmlStreamReader &oReader, PathTable &oPaths, QString &sMsgError, int iNumExpectedFeatures, FaceTopology *pTopology)
 {
 	// Check the element name
-	if(oElement.tagName() != "Sample")
+	if(oReader.name() != "Sample")
 	{
-		sMsgError = QString(QApplication::translate("FaceImage", "invalid node name [%1] - expected node '%2'").arg(oElement.tagName(), "Sample"));
+		sMsgError = QString(QApplication::translate("FaceImage", "invalid node name [%1] - expected node '%2'").arg(oReader.name().toString(), "Sample"));
 		return false;
 	}
 
 	// Read the file name
-	QString sFile = oElement.attribute("fileName");
+	QString sFile = oReader.attributes().value("fileName").toString();
 	if(sFile == "")
 	{
 		sMsgError = QString(QApplication::translate("FaceImage", "the attribute '%1' does not exist or it contains an invalid value").arg("fileName"));
@@ -88,67 +224,107 @@ bool ft::FaceImage::loadFromXML(const QDomElement &oElement, QString &sMsgError,
 	}
 
 	// Read the face features
-	// Sample images
-	QDomElement oFeatures = oElement.firstChildElement("Features");
-	if(oFeatures.isNull() || oFeatures.childNodes().count() != iNumExpectedFeatures)
+	bool bFeatures = false;
+	bool bFailed = false;
+	QVector<float> vX, vY;
+	vector<int> vConnections;
+	if(iNumExpectedFeatures > 0)
 	{
-		sMsgError = QString(QApplication::translate("FaceImage", "the node '%1' does not exist or it contains less children nodes than expected").arg("Features"));
-		return false;
+		vX.reserve(2 * iNumExpectedFeatures);
+		vY.reserve(iNumExpectedFeatures);
 	}
 
-	vector<FaceFeature*> vFeatures;
-	for(QDomElement oElement = oFeatures.firstChildElement(); !oElement.isNull(); oElement = oElement.nextSiblingElement())
+	while(!bFailed && oReader.readNextStartElement())
 	{
-		FaceFeature *pFeature = new FaceFeature();
-		if(!pFeature->loadFromXML(oElement, sMsgError))
+		if(oReader.name() != "Features" || bFeatures)
 		{
-			foreach(FaceFeature *pFeat, vFeatures)
-				delete(pFeat);
-			delete pFeature;
+			oReader.skipCurrentElement();
+			continue;
+		}
 
-			return false;
+		bFeatures = true;
+		while(oReader.readNextStartElement())
+		{
+			FaceFeature oFeature;
+			if(!oFeature.loadFromXML(oReader, sMsgError, pTopology ? &vConnections : NULL))
+			{
+				bFailed = true;
+				break;
+			}
+			vX.push_back(oFeature.x());
+			vY.push_back(oFeature.y());
+
+			// The identical connections of all images are collapsed in the topology
+			if(pTopology)
+				foreach(int iID, vConnections)
+					pTopology->connect(oFeature.getID(), iID);
 		}
-		vFeatures.push_back(pFeature);
 	}
 
+	if(!bFailed && !oReader.hasError() && (!bFeatures || (int) vX.size() != iNumExpectedFeatures))
+	{
+		sMsgError = QString(QApplication::translate("FaceImage", "the node '%1' does not exist or it contains less children nodes than expected").arg("Features"));
+		bFailed = true;
+	}
+
+	if(bFailed || oReader.hasError())
+		return false;
+
+	// The y coordinates are stored after all the x coordinates
+	vX += vY;
+
 	clear();
-	m_sFileName = sFile;
-	m_vFeatures = vFeatures;
+	oPaths.resolve(sFile, m_iDirectory, m_sBaseName);
+	m_vCoords.swap(vX);
+	m_bLoaded = true;
 	return true;
 }
 
 // +-----------------------------------------------------------
-void ft::FaceImage::saveToXML(QDomElement &oParent) const
+bool ft::FaceImage::loadFromXML(const QByteArray &oData, const QDir &oBase, QString &sMsgError, int iNumExpectedFeatures, FaceTopology *pTopology)
 {
-	// Add the "Sample" node
-	QDomElement oSample = oParent.ownerDocument().createElement("Sample");
-	oParent.appendChild(oSample);
+	QXmlStreamReader oReader(oData);
+	oReader.readNextStartElement();
+	PathTable oPaths(oBase);
+	if(!loadFromXML(oReader, oPaths, sMsgError, iNumExpectedFeatures, pTopology))
+	{
+		if(oReader.hasError())
+			sMsgError = oReader.errorString();
+		return false;
+	}
+
+	return true;
+}
 
-	// Define it's attributes
-	oSample.setAttribute("fileName", m_sFileName);
+// +-----------------------------------------------------------
+void ft::FaceImage::saveToXML(QXmlStreamWriter &oWriter, PathTable &oPaths) const
+{
+	// Add the "Sample" node and define it's attributes
+	oWriter.writeStartElement("Sample");
+	oWriter.writeAttribute("fileName", oPaths.relativeFilePath(m_iDirectory, m_sBaseName));
 
-	// Add the "Features" subnode
-	QDomElement oFeatures = oParent.ownerDocument().createElement("Features");
-	oSample.appendChild(oFeatures);
+	// Add the "Features" subnode and the nodes for the features
+	oWriter.writeStartElement("Features");
+	for(int i = 0; i < numFeatures(); i++)
+		getFeature(i).saveToXML(oWriter);
+	oWriter.writeEndElement();
 
-	// Add the nodes for the features
-	foreach(FaceFeature *pFeat, m_vFeatures)
-		pFeat->saveToXML(oFeatures);
+	oWriter.writeEndElement();
 }
 
 // +-----------------------------------------------------------
 QPixmap ft::FaceImage::pixMap() const
 {
-	QPixmap oRet;
-	oRet.load(m_sFileName);
-	return oRet;
+	// The decoded image is shared with the other datasets that use the same file
+	return QPixmap::fromImage(ImageCache::image(fileName()));
 }
 
 // +-----------------------------------------------------------
 bool ft::FaceImage::loadPtsFile(QString & errstr, int iNumExpectedFeatures)
 {
-	int last_dot = m_sFileName.lastIndexOf(".");
-	QString fn = m_sFileName.mid(0, last_dot) + ".pts";
+	QString sFileName = fileName();
+	int last_dot = sFileName.lastIndexOf(".");
+	QString fn = sFileName.mid(0, last_dot) + ".pts";
 	int n_points = -1;
 	QString keyword;
 	int value;
@@ -210,13 +386,10 @@ bool ft::FaceImage::loadPtsFile(QString & errstr, int iNumExpectedFeatures)
 	}
 
 	// read points
-	float x, y;
-	m_vFeatures.clear();
+	vector<float> vPoints(2 * n_points);
 	for (int i = 0; i < n_points; ++i)
-	{
-		in >> x >> y;
-		m_vFeatures.push_back(new FaceFeature(i, x, y));
-	}
+		in >> vPoints[2 * i] >> vPoints[2 * i + 1];
+	setFeatures(vPoints.data(), n_points);
 
 	if (in.atEnd())
 	{
@@ -224,21 +397,21 @@ bool ft::FaceImage::loadPtsFile(QString & errstr, int iNumExpectedFeatures)
 		return false;
 	}
 
+	// the PTS file holds the current points
+	m_iPtsRevision = m_iRevision;
+	m_bPtsSaved = true;
 	return true;
 }
 
 // +-----------------------------------------------------------
-bool ft::FaceImage::savePtsFile(bool keep_backup)
+bool ft::FaceImage::savePtsFile()
 {
-	int last_dot = m_sFileName.lastIndexOf(".");
-	QString fn = m_sFileName.mid(0, last_dot) + ".pts";
+	QString sFileName = fileName();
+	int last_dot = sFileName.lastIndexOf(".");
+	QString fn = sFileName.mid(0, last_dot) + ".pts";
 
-	// todo:
-	// - add change bool per FaceImage, set in ft::ChildWindow::updateFeaturesInDataset()
-	// - check for changes, keep backup %1_backup001.pts
-	// - GUI: option whether to save backup
-
-	if (m_vFeatures.empty())
+	// nothing to do if the PTS file already holds the current points
+	if (numFeatures() == 0 || (m_bPtsSaved && m_iPtsRevision == m_iRevision))
 		return true;
 
 	QFile oFile(fn);
@@ -247,78 +420,210 @@ bool ft::FaceImage::savePtsFile(bool keep_backup)
 
 	QTextStream oStream(&oFile);
 	oStream << "version: 1" << endl;
-	oStream << QString("n_points: %1").arg(m_vFeatures.size()) << endl;
+	oStream << QString("n_points: %1").arg(numFeatures()) << endl;
 	oStream << "{" << endl;
 
-	foreach(FaceFeature *pFeat, m_vFeatures)
+	for (int i = 0; i < numFeatures(); i++)
 	{
-		oStream << QString("%1\t%2").arg(pFeat->x()).arg(pFeat->y()) << endl;
+		oStream << QString("%1\t%2").arg(x(i)).arg(y(i)) << endl;
 	}
 	oStream << "}" << endl;
+	oStream.flush();
 	oFile.close();
 
+	// the file is only known to hold the points if it was completely written
+	if (oStream.status() != QTextStream::Ok || oFile.error() != QFileDevice::NoError)
+		return false;
+
+	m_iPtsRevision = m_iRevision;
+	m_bPtsSaved = true;
 	return true;
 }
 
 // +-----------------------------------------------------------
-ft::FaceFeature* ft::FaceImage::addFeature(int iID, float x, float y)
+int ft::FaceImage::numFeatures() const
 {
-	FaceFeature *pFeat = new FaceFeature(iID, x, y);
-	m_vFeatures.push_back(pFeat);
-	return pFeat;
+	return (m_bCompact ? m_vFixed.size() : m_vCoords.size()) / 2;
 }
 
 // +-----------------------------------------------------------
-ft::FaceFeature* ft::FaceImage::getFeature(const int iIndex) const
+void ft::FaceImage::addFeature(float x, float y)
 {
-	if(iIndex < 0 || iIndex >= (int) m_vFeatures.size())
-		return NULL;
-	return m_vFeatures[iIndex];
+	qint16 iX, iY;
+	if(m_bCompact && toFixed(x, iX) && toFixed(y, iY))
+	{
+		m_vFixed.insert(m_vFixed.begin() + numFeatures(), iX);
+		m_vFixed.push_back(iY);
+	}
+	else
+	{
+		// A coordinate out of the range of the compact mode makes the image use floats
+		setCompact(false);
+		m_vCoords.insert(m_vCoords.begin() + numFeatures(), x);
+		m_vCoords.push_back(y);
+	}
+	setModified();
 }
 
 // +-----------------------------------------------------------
-const std::vector<ft::FaceFeature*> & ft::FaceImage::getFeatures() const
+void ft::FaceImage::setFeatures(const float *pPoints, int iNumFeats)
 {
-	return m_vFeatures;
+	// The image is kept in the compact mode if the new coordinates fit
+	bool bCompact = m_bCompact;
+	m_vFixed.clear();
+	m_bCompact = false;
+
+	m_vCoords.resize(2 * iNumFeats);
+	for(int i = 0; i < iNumFeats; i++)
+	{
+		m_vCoords[i] = pPoints[2 * i];
+		m_vCoords[iNumFeats + i] = pPoints[2 * i + 1];
+	}
+	if(bCompact)
+		setCompact(true);
+	setModified();
 }
 
 // +-----------------------------------------------------------
-bool ft::FaceImage::removeFeature(const int iIndex)
+void ft::FaceImage::setFixedFeatures(const qint16 *pPoints, int iNumFeats)
 {
-	if(iIndex < 0 || iIndex >= (int) m_vFeatures.size())
-		return false;
+	m_vCoords.clear();
+	m_bCompact = true;
 
-	FaceFeature *pFeat = m_vFeatures[iIndex];
-	m_vFeatures.erase(m_vFeatures.begin() + iIndex);
-	delete pFeat;
+	m_vFixed.resize(2 * iNumFeats);
+	for(int i = 0; i < iNumFeats; i++)
+	{
+		m_vFixed[i] = pPoints[2 * i];
+		m_vFixed[iNumFeats + i] = pPoints[2 * i + 1];
+	}
+	setModified();
+}
 
-	return true;
+// +-----------------------------------------------------------
+ft::FaceFeature ft::FaceImage::getFeature(const int iIndex) const
+{
+	if(iIndex < 0 || iIndex >= numFeatures())
+		return FaceFeature();
+	return FaceFeature(iIndex, x(iIndex), y(iIndex));
 }
 
 // +-----------------------------------------------------------
-bool ft::FaceImage::connectFeatures(int iIDSource, int iIDTarget)
+bool ft::FaceImage::moveFeature(const int iIndex, float x, float y)
 {
-	if (iIDSource < 0 || iIDSource >= (int)m_vFeatures.size())
-		return false;
-	if (iIDTarget < 0 || iIDTarget >= (int)m_vFeatures.size())
+	if(iIndex < 0 || iIndex >= numFeatures())
 		return false;
 
-	FaceFeature *pSource = m_vFeatures[iIDSource];
-	FaceFeature *pTarget = m_vFeatures[iIDTarget];
-	pSource->connectTo(pTarget);
+	qint16 iX, iY;
+	if(m_bCompact && toFixed(x, iX) && toFixed(y, iY))
+	{
+		m_vFixed[iIndex] = iX;
+		m_vFixed[numFeatures() + iIndex] = iY;
+	}
+	else
+	{
+		// A coordinate out of the range of the compact mode makes the image use floats
+		setCompact(false);
+		m_vCoords[iIndex] = x;
+		m_vCoords[numFeatures() + iIndex] = y;
+	}
+	setModified();
 	return true;
 }
 
 // +-----------------------------------------------------------
-bool ft::FaceImage::disconnectFeatures(int iIDSource, int iIDTarget)
+bool ft::FaceImage::isAt(const int iIndex, float x, float y) const
 {
-	if (iIDSource < 0 || iIDSource >= (int)m_vFeatures.size())
-		return false;
-	if (iIDTarget < 0 || iIDTarget >= (int)m_vFeatures.size())
+	if(!m_bCompact)
+		return m_vCoords.at(iIndex) == x && m_vCoords.at(numFeatures() + iIndex) == y;
+
+	qint16 iX, iY;
+	return toFixed(x, iX) && toFixed(y, iY) && m_vFixed.at(iIndex) == iX && m_vFixed.at(numFeatures() + iIndex) == iY;
+}
+
+// +-----------------------------------------------------------
+float ft::FaceImage::x(const int iIndex) const
+{
+	if(m_bCompact)
+		return (float) m_vFixed.at(iIndex) / FIXED_POINT_SCALE;
+	return m_vCoords.at(iIndex);
+}
+
+// +-----------------------------------------------------------
+float ft::FaceImage::y(const int iIndex) const
+{
+	if(m_bCompact)
+		return (float) m_vFixed.at(numFeatures() + iIndex) / FIXED_POINT_SCALE;
+	return m_vCoords.at(numFeatures() + iIndex);
+}
+
+// +-----------------------------------------------------------
+const float* ft::FaceImage::xCoordinates() const
+{
+	return m_bCompact ? NULL : m_vCoords.data();
+}
+
+// +-----------------------------------------------------------
+const float* ft::FaceImage::yCoordinates() const
+{
+	return m_bCompact ? NULL : m_vCoords.data() + numFeatures();
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceImage::isCompact() const
+{
+	return m_bCompact;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceImage::setCompact(bool bCompact)
+{
+	if(bCompact == m_bCompact)
+		return true;
+
+	if(bCompact)
+	{
+		const float *pCoords = m_vCoords.constData();
+		QVector<qint16> vFixed(m_vCoords.size());
+		for(int i = 0; i < vFixed.size(); i++)
+			if(!toFixed(pCoords[i], vFixed[i]))
+				return false;
+		m_vFixed.swap(vFixed);
+		m_vCoords = QVector<float>();
+	}
+	else
+	{
+		const qint16 *pFixed = m_vFixed.constData();
+		QVector<float> vCoords(m_vFixed.size());
+		for(int i = 0; i < vCoords.size(); i++)
+			vCoords[i] = (float) pFixed[i] / FIXED_POINT_SCALE;
+		m_vCoords.swap(vCoords);
+		m_vFixed = QVector<qint16>();
+	}
+
+	m_bCompact = bCompact;
+	return true;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceImage::removeFeature(const int iIndex)
+{
+	return removeFeatures(vector<int>(1, iIndex));
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceImage::removeFeatures(const vector<int> &vIndexes)
+{
+	int iNumFeats = numFeatures();
+	if(vIndexes.empty())
+		return true;
+	if(vIndexes.front() < 0 || vIndexes.back() >= iNumFeats)
 		return false;
 
-	FaceFeature *pSource = m_vFeatures[iIDSource];
-	FaceFeature *pTarget = m_vFeatures[iIDTarget];
-	pSource->disconnectFrom(pTarget);
+	if(m_bCompact)
+		removeIndexes(m_vFixed, iNumFeats, vIndexes);
+	else
+		removeIndexes(m_vCoords, iNumFeats, vIndexes);
+	setModified();
+
 	return true;
-}
\ No newline at end of file
+}
@@ -22,11 +22,16 @@
 #define FACE_IMAGE_H
 
 #include "facefeature.h"
+#include "facetopology.h"
 #include "facefeatureedge.h"
+#include "pathtable.h"
 
 #include <QString>
+#include <QVector>
 #include <QPixmap>
-#include <QDomDocument>
+#include <QDir>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
 
 #include <vector>
 #include <string>
@@ -35,11 +40,18 @@ namespace ft
 {
 	/**
 	 * Represents the data from one facial image sample in the image dataset, including its
-     * annotations (facial features, their connections, and the face emotional label).
+     * annotations (facial features and the face emotional label; the connections among the
+	 * features are the same in all images, so they are stored by the dataset).
 	 */
 	class FaceImage
     {
 	public:
+		/**
+		 * Number of steps per pixel of the coordinates stored in the compact (fixed-point)
+		 * mode, in which each coordinate takes 16 bits and has a precision of 1/16 pixel.
+		 */
+		static const int FIXED_POINT_SCALE;
+
 		/**
 		 * Class constructor.
 		 * @param sFileName String with the file name of the face image. If defined as empty in the
@@ -53,7 +65,8 @@ namespace ft
 		virtual ~FaceImage();
 
 		/**
-		 * Copy features from oImg to this.
+		 * Copy features from oImg to this. The coordinates are shared by both images (in
+		 * constant time) until any of them is changed.
 		 * @param oImg Source image for copying features.
 		 */
 		void copyFeaturesFrom(const FaceImage * oImg);
@@ -71,30 +84,194 @@ namespace ft
 		void setFileName(QString sFileName);
 
 		/**
-		 * Adds a new face feature to the face image.
-		 * @param iID Integer with the ID of the face feature.
+		 * Sets the file name of the face image from its directory in the PathTable.
+		 * @param iDirectory Integer with the identifier of the directory of the file.
+		 * @param sBaseName QString with the base name of the file.
+		 */
+		void setFileName(int iDirectory, const QString &sBaseName);
+
+		/**
+		 * Gets the identifier of the directory of the face image file in the PathTable.
+		 * @return Integer with the identifier of the directory, or -1 if the file name has none.
+		 */
+		int directory() const;
+
+		/**
+		 * Gets the base name (the name without the directory) of the face image file.
+		 * @return QString with the base name of the file.
+		 */
+		QString baseName() const;
+
+		/**
+		 * Indicates if the face image data (the face features) is in memory. It is not if the
+		 * image was indexed from a dataset file opened lazily and has not been parsed yet.
+		 * @return Boolean indicating if the image data is loaded (true) or not (false).
+		 */
+		bool isLoaded() const;
+
+		/**
+		 * Indicates if the location of the image node in the dataset file is known.
+		 * @return Boolean indicating if the image has a source node (true) or not (false).
+		 */
+		bool hasSource() const;
+
+		/**
+		 * Gets the offset of the image node in the dataset file.
+		 * @return Integer with the offset in bytes, or -1 if the image has no source node.
+		 */
+		qint64 sourceOffset() const;
+
+		/**
+		 * Gets the size of the image node in the dataset file.
+		 * @return Integer with the size in bytes, or 0 if the image has no source node.
+		 */
+		qint64 sourceLength() const;
+
+		/**
+		 * Defines the location of the image node in the dataset file, from which the image
+		 * data is read when it is first needed (if not loaded) or copied when the dataset is
+		 * saved (if not modified). Passing a negative offset removes the source node.
+		 * @param iOffset Integer with the offset in bytes of the image node in the file.
+		 * @param iLength Integer with the size in bytes of the image node in the file.
+		 * @param bLoaded Boolean indicating if the image data is already in memory.
+		 */
+		void setSource(qint64 iOffset, qint64 iLength, bool bLoaded = true);
+
+		/**
+		 * Marks the image data as changed. This is done automatically by the methods that
+		 * change the face features.
+		 */
+		void setModified();
+
+		/**
+		 * Gets the revision of the image data, that is incremented at each change.
+		 * @return Unsigned integer with the current revision.
+		 */
+		unsigned int revision() const;
+
+		/**
+		 * Indicates if the image data has changed since it was last loaded from or saved to
+		 * the dataset file.
+		 * @return Boolean indicating if the image was modified (true) or not (false).
+		 */
+		bool isModified() const;
+
+		/**
+		 * Marks the given revision of the image data as saved in the dataset file.
+		 * @param iRevision Unsigned integer with the revision saved.
+		 */
+		void setSaved(unsigned int iRevision);
+
+		/**
+		 * Gets the number of face features in the image.
+		 * @return Integer with the number of face features.
+		 */
+		int numFeatures() const;
+
+		/**
+		 * Adds a new face feature to the face image (after the existing ones, so its ID
+		 * is the previous number of features).
 		 * @param x Float with the x coordinate of the face feature.
 		 * @param y Float with the y coordinate of the face feature.
-		 * @return Instance of a FaceFeature with the new feature created.
 		 */
-		FaceFeature *addFeature(int iID, float x = 0.0f, float y = 0.0f);
+		void addFeature(float x = 0.0f, float y = 0.0f);
 
 		/**
-		 * Gets the face feature at the given index.
+		 * Replaces all face features of the image.
+		 * @param pPoints Pointer to an array with the (x, y) coordinates of each feature.
+		 * @param iNumFeats Integer with the number of features in the array.
+		 */
+		void setFeatures(const float *pPoints, int iNumFeats);
+
+		/**
+		 * Gets the face feature at the given index. The feature is a copy of the data in
+		 * the image (the features are changed with moveFeature).
 		 * @param iIndex Integer with the index of the feature to be obtained.
-		 * @return Instance of the face feature at the index or NULL if the index 
-		 * is out of bounds.
+		 * @return FaceFeature with the ID (the index) and the coordinates of the feature,
+		 * or with the ID -1 if the index is out of bounds.
+		 */
+		FaceFeature getFeature(const int iIndex) const;
+
+		/**
+		 * Moves the face feature at the given index.
+		 * @param iIndex Integer with the index of the feature to be moved.
+		 * @param x Float with the new x coordinate of the face feature.
+		 * @param y Float with the new y coordinate of the face feature.
+		 * @return Boolean indicating if the face feature was moved (true) or not (false,
+		 * if the index is out of bounds).
+		 */
+		bool moveFeature(const int iIndex, float x, float y);
+
+		/**
+		 * Indicates if the face feature at the given index is at the given position, in the
+		 * precision in which the coordinates are stored (so moving the feature to the position
+		 * would not change it).
+		 * @param iIndex Integer with the index of the feature (the index is not checked).
+		 * @param x Float with the x coordinate of the position.
+		 * @param y Float with the y coordinate of the position.
+		 * @return Boolean indicating if the feature is at the position (true) or not (false).
+		 */
+		bool isAt(const int iIndex, float x, float y) const;
+
+		/**
+		 * Gets the x coordinate of the face feature at the given index (the index is not checked).
+		 * @param iIndex Integer with the index of the feature.
+		 * @return Float with the x coordinate of the feature.
+		 */
+		float x(const int iIndex) const;
+
+		/**
+		 * Gets the y coordinate of the face feature at the given index (the index is not checked).
+		 * @param iIndex Integer with the index of the feature.
+		 * @return Float with the y coordinate of the feature.
+		 */
+		float y(const int iIndex) const;
+
+		/**
+		 * Gets the x coordinates of all face features, which are stored contiguously (so
+		 * they can be scanned linearly). The pointer is valid until the features are changed.
+		 * @return Pointer to the array with numFeatures() x coordinates, or NULL if the
+		 * coordinates are stored in the compact mode (they must then be read with x()).
+		 */
+		const float* xCoordinates() const;
+
+		/**
+		 * Gets the y coordinates of all face features, which are stored contiguously (so
+		 * they can be scanned linearly). The pointer is valid until the features are changed.
+		 * @return Pointer to the array with numFeatures() y coordinates, or NULL if the
+		 * coordinates are stored in the compact mode (they must then be read with y()).
+		 */
+		const float* yCoordinates() const;
+
+		/**
+		 * Indicates if the coordinates are stored in the compact mode, as 16 bits fixed-point
+		 * values (see FIXED_POINT_SCALE).
+		 * @return Boolean indicating if the coordinates are compact (true) or floats (false).
 		 */
-		FaceFeature *getFeature(const int iIndex) const;
+		bool isCompact() const;
 
 		/**
-		 * Gets all face features in the image.
-		 * @return Vector with all instances of face features in the image.
+		 * Changes the storage of the coordinates. In the compact mode they are rounded to
+		 * the precision of the fixed-point values, which only represent the coordinates in
+		 * [-2048, 2048) pixels: if any coordinate is outside that range, the image is kept
+		 * with floats. The features themselves are not considered changed.
+		 * @param bCompact Boolean indicating if the coordinates must be compact (true) or floats (false).
+		 * @return Boolean indicating if the coordinates are now stored as requested (true) or
+		 * not (false, if they do not fit in the compact mode).
 		 */
-		const std::vector<FaceFeature*> & getFeatures() const;
+		bool setCompact(bool bCompact);
 
 		/**
-		 * Removes the face feature at the given index.
+		 * Replaces all face features of the image by the given fixed-point coordinates (so the
+		 * coordinates are then stored in the compact mode).
+		 * @param pPoints Pointer to an array with the (x, y) fixed-point coordinates of each feature.
+		 * @param iNumFeats Integer with the number of features in the array.
+		 */
+		void setFixedFeatures(const qint16 *pPoints, int iNumFeats);
+
+		/**
+		 * Removes the face feature at the given index (the features after it are then
+		 * identified by their new indices).
 		 * @param iIndex Integer with the index of the feature to be removed.
 		 * @return Boolean indicating if the face feature was successfully
 		 * removed (true) or not (false).
@@ -102,39 +279,56 @@ namespace ft
 		bool removeFeature(const int iIndex);
 
 		/**
-		* Connects the two given features.
-		* @param iIDSource Integer with the ID (index) of the source feature.
-		* @param iIDTarget Integer with the ID (index) of the target feature.
-		* @return Boolean indicating if the connection was successfully created.
-		*/
-		bool connectFeatures(int iIDSource, int iIDTarget);
+		 * Removes the face features at the given indices at once (the coordinates of the
+		 * remaining features are compacted in a single pass).
+		 * @param vIndexes Std vector with the indices of the features to be removed, in
+		 * ascending order and without repetitions.
+		 * @return Boolean indicating if the face features were successfully
+		 * removed (true) or not (false, if any index is out of range).
+		 */
+		bool removeFeatures(const std::vector<int> &vIndexes);
 
 		/**
-		* Disconnects the two given features.
-		* @param iIDSource Integer with the ID (index) of the source feature.
-		* @param iIDTarget Integer with the ID (index) of the target feature.
-		* @return Boolean indicating if the connection was successfully removed.
-		*/
-		bool disconnectFeatures(int iIDSource, int iIDTarget);
+		 * Loads (unserializes) the face image data from the given xml stream. The reader must be
+		 * positioned at the start of the image node, and it is left at the end of that node.
+		 * @param oReader QXmlStreamReader from where to read the image data (the image node in the xml).
+		 * @param oPaths PathTable used to resolve the image file name in the xml.
+		 * @param sMsgError QString to receive the error message in case the method fails. It is not
+		 * changed if the failure is an xml syntax error (that is reported by the reader itself).
+		 * @param iNumExpectedFeatures Integer with the number of expected features.
+		 * @param pTopology Pointer to the FaceTopology to receive the connections stored in the
+		 * features by the old versions of the dataset file, or NULL (the default) if the
+		 * connections are stored only for the whole dataset.
+		 * @return Boolean indicating if the loading was successful (true) or if it failed (false).
+		 */
+		bool loadFromXML(QXmlStreamReader &oReader, PathTable &oPaths, QString &sMsgError, int iNumExpectedFeatures, FaceTopology *pTopology = NULL);
 
 		/**
-		 * Loads (unserializes) the face image data from the given xml element.
-		 * @param oElement QDomElement from where to read the image data (the image node in the xml).
+		 * Loads (unserializes) the face image data from the given xml data, that must contain
+		 * only the image node. The image file name is made absolute using the given directory.
+		 * @param oData QByteArray with the xml of the image node.
+		 * @param oBase QDir with the directory to which the file name in the xml is relative.
 		 * @param sMsgError QString to receive the error message in case the method fails.
 		 * @param iNumExpectedFeatures Integer with the number of expected features.
+		 * @param pTopology Pointer to the FaceTopology to receive the connections stored in the
+		 * features by the old versions of the dataset file, or NULL (the default).
 		 * @return Boolean indicating if the loading was successful (true) or if it failed (false).
 		 */
-		bool loadFromXML(const QDomElement &oElement, QString &sMsgError, int iNumExpectedFeatures);
+		bool loadFromXML(const QByteArray &oData, const QDir &oBase, QString &sMsgError, int iNumExpectedFeatures, FaceTopology *pTopology = NULL);
 
         /**
-         * Saves the face image data into the given xml element.
-		 * @param oParent Parent QDomElement to receive the new node of the face image data.
+         * Saves the face image data into the given xml stream, as a new image node inside
+		 * the node currently open in the writer. The image file name is written relative
+		 * to the base directory of the given path table (the image data itself is not changed).
+		 * @param oWriter QXmlStreamWriter to receive the new node of the face image data.
+		 * @param oPaths PathTable used to make the file name relative.
          */
-        void saveToXML(QDomElement &oParent) const;
+        void saveToXML(QXmlStreamWriter &oWriter, PathTable &oPaths) const;
 
 		/**
-		 * Loads and returns the image data as a Qt's QPixmap. If an error occur during the loading of
-		 * the file, an empty QPixmap is returned instead (that can be checked with QPixmap::isNull()).
+		 * Loads and returns the image data as a Qt's QPixmap (the file is decoded through the ImageCache).
+		 * If an error occur during the loading of the file, an empty QPixmap is returned instead (that
+		 * can be checked with QPixmap::isNull()).
 		 * @return A QPixmap with the image data, or an empty QPixmap if an error ocurred.
 		 */
 		QPixmap pixMap() const;
@@ -148,11 +342,10 @@ namespace ft
 		bool loadPtsFile(QString & errstr, int iNumExpectedFeatures = -1);
 
 		/**
-		 * Save point coordinates to PTS file (if changed).
-		 * @param keep_backup Whether old PTS file should be kept as backup.
+		 * Save point coordinates to PTS file (if changed since it was last loaded or saved).
 		 * @return True if successful.
 		 */
-		bool savePtsFile(bool keep_backup = true);
+		bool savePtsFile();
 	protected:
 
 		/**
@@ -162,11 +355,49 @@ namespace ft
 
 	private:
 
-		/** Name of the file with the face image. */
-		QString m_sFileName;
+		/** Identifier of the directory of the file with the face image (in the PathTable), or -1. */
+		int m_iDirectory;
+
+		/** Base name of the file with the face image. */
+		QString m_sBaseName;
+
+		/**
+		 * Coordinates of the face features in this face image: first the x coordinates of all
+		 * features, then their y coordinates. The features are identified by their indices.
+		 * The coordinates are implicitly shared with the images they were copied from (or to)
+		 * until they are changed.
+		 */
+		QVector<float> m_vCoords;
+
+		/**
+		 * Coordinates of the face features in the compact mode, as fixed-point values (in the
+		 * same order as m_vCoords, which is then empty).
+		 */
+		QVector<qint16> m_vFixed;
+
+		/** Indication if the coordinates are stored in the compact mode (in m_vFixed). */
+		bool m_bCompact;
+
+		/** Offset of the image node in the dataset file, or -1. */
+		qint64 m_iSourceOffset;
+
+		/** Size of the image node in the dataset file, or 0. */
+		qint64 m_iSourceLength;
+
+		/** Indication if the image data is in memory. */
+		bool m_bLoaded;
+
+		/** Revision of the image data (incremented at each change). */
+		unsigned int m_iRevision;
+
+		/** Revision of the image data saved in the dataset file. */
+		unsigned int m_iSavedRevision;
+
+		/** Revision of the image data saved in the PTS file. */
+		unsigned int m_iPtsRevision;
 
-		/** Vector of the face features in this face image. */
-		std::vector<FaceFeature*> m_vFeatures;
+		/** Indication if the PTS file is known to hold the revision m_iPtsRevision. */
+		bool m_bPtsSaved;
     };
 }
 
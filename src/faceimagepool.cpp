@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "faceimagepool.h"
+
+#include <new>
+
+using namespace std;
+
+namespace
+{
+	/** Number of images in the blocks allocated when no block was reserved. */
+	const int BLOCK_SIZE = 1024;
+}
+
+// +-----------------------------------------------------------
+ft::FaceImagePool::FaceImagePool()
+{
+	m_iCapacity = 0;
+	m_iUsed = 0;
+}
+
+// +-----------------------------------------------------------
+ft::FaceImagePool::~FaceImagePool()
+{
+	release();
+}
+
+// +-----------------------------------------------------------
+void ft::FaceImagePool::reserve(int iCount)
+{
+	int iAvailable = (int) m_vFree.size() + m_iCapacity - m_iUsed;
+	if(iCount > iAvailable)
+		allocateBlock(iCount - (int) m_vFree.size());
+}
+
+// +-----------------------------------------------------------
+ft::FaceImage* ft::FaceImagePool::create(const QString &sFileName)
+{
+	void *pSlot;
+	if(!m_vFree.empty())
+	{
+		pSlot = m_vFree.back();
+		m_vFree.pop_back();
+	}
+	else
+	{
+		if(m_iUsed == m_iCapacity)
+			allocateBlock(BLOCK_SIZE);
+		pSlot = m_vBlocks.back() + m_iUsed * sizeof(FaceImage);
+		m_iUsed++;
+	}
+
+	return new(pSlot) FaceImage(sFileName);
+}
+
+// +-----------------------------------------------------------
+void ft::FaceImagePool::destroy(FaceImage *pImage)
+{
+	if(!pImage)
+		return;
+
+	pImage->~FaceImage();
+	m_vFree.push_back(pImage);
+}
+
+// +-----------------------------------------------------------
+void ft::FaceImagePool::merge(FaceImagePool &oOther)
+{
+	if(&oOther == this || oOther.m_vBlocks.empty())
+		return;
+
+	// The current block of the other pool becomes the current block of this one
+	retireBlock();
+	m_vBlocks.insert(m_vBlocks.end(), oOther.m_vBlocks.begin(), oOther.m_vBlocks.end());
+	m_vFree.insert(m_vFree.end(), oOther.m_vFree.begin(), oOther.m_vFree.end());
+	m_iCapacity = oOther.m_iCapacity;
+	m_iUsed = oOther.m_iUsed;
+
+	oOther.m_vBlocks.clear();
+	oOther.m_vFree.clear();
+	oOther.m_iCapacity = 0;
+	oOther.m_iUsed = 0;
+}
+
+// +-----------------------------------------------------------
+void ft::FaceImagePool::release()
+{
+	for(int i = 0; i < (int) m_vBlocks.size(); i++)
+		::operator delete(m_vBlocks[i]);
+
+	vector<char*>().swap(m_vBlocks);
+	vector<FaceImage*>().swap(m_vFree);
+	m_iCapacity = 0;
+	m_iUsed = 0;
+}
+
+// +-----------------------------------------------------------
+void ft::FaceImagePool::clear(const vector<FaceImage*> &vImages)
+{
+	for(int i = 0; i < (int) vImages.size(); i++)
+		vImages[i]->~FaceImage();
+	release();
+}
+
+// +-----------------------------------------------------------
+void ft::FaceImagePool::allocateBlock(int iCapacity)
+{
+	retireBlock();
+	m_vBlocks.push_back((char *) ::operator new(iCapacity * sizeof(FaceImage)));
+	m_iCapacity = iCapacity;
+	m_iUsed = 0;
+}
+
+// +-----------------------------------------------------------
+void ft::FaceImagePool::retireBlock()
+{
+	for(int i = m_iUsed; i < m_iCapacity; i++)
+		m_vFree.push_back((FaceImage *) (m_vBlocks.back() + i * sizeof(FaceImage)));
+	m_iUsed = m_iCapacity;
+}
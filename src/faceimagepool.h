@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FACEIMAGEPOOL_H
+#define FACEIMAGEPOOL_H
+
+#include "faceimage.h"
+
+#include <vector>
+
+namespace ft
+{
+	/**
+	 * Pool from which the face images of a dataset are allocated. The images are created in
+	 * large blocks of memory (a block can be reserved for all the images of a file before they
+	 * are read), so loading a dataset does not allocate each image separately, and the blocks
+	 * are all freed at once when the dataset is cleared. The slots of the destroyed images are
+	 * reused by the next images created. The pool is not thread safe: each thread must use its
+	 * own pool, which can then be merged into the pool of the dataset.
+	 */
+	class FaceImagePool
+	{
+	public:
+		/**
+		 * Class constructor.
+		 */
+		FaceImagePool();
+
+		/**
+		 * Class destructor. All the images created by the pool must have been destroyed,
+		 * since the memory is freed without calling their destructors.
+		 */
+		virtual ~FaceImagePool();
+
+		/**
+		 * Makes sure that the given number of images can be created without allocating
+		 * another block of memory.
+		 * @param iCount Integer with the number of images to create.
+		 */
+		void reserve(int iCount);
+
+		/**
+		 * Creates a new face image in the pool.
+		 * @param sFileName String with the file name of the face image.
+		 * @return Pointer to the new FaceImage (that must be destroyed only by the pool).
+		 */
+		FaceImage* create(const QString &sFileName = QString());
+
+		/**
+		 * Destroys the given face image, so its slot can be reused.
+		 * @param pImage Pointer to the FaceImage created by the pool.
+		 */
+		void destroy(FaceImage *pImage);
+
+		/**
+		 * Takes all the memory of the given pool, so the images created by it become owned
+		 * by this pool (the other pool is left empty).
+		 * @param oOther FaceImagePool to merge into this pool.
+		 */
+		void merge(FaceImagePool &oOther);
+
+		/**
+		 * Frees all the memory of the pool at once. All the images created by the pool must
+		 * have been destroyed.
+		 */
+		void release();
+
+		/**
+		 * Destroys all the images of the pool and frees all its memory at once. The slots are
+		 * not reused, so they are not kept as free (as done by destroy).
+		 * @param vImages Std vector with all the images created by the pool and not destroyed yet.
+		 */
+		void clear(const std::vector<FaceImage*> &vImages);
+
+	protected:
+
+		/**
+		 * Allocates a new block of memory, from which the next images are created.
+		 * @param iCapacity Integer with the number of images that fit in the block.
+		 */
+		void allocateBlock(int iCapacity);
+
+		/**
+		 * Moves the slots not yet used in the current block to the list of free slots.
+		 */
+		void retireBlock();
+
+	private:
+
+		/** Blocks of memory allocated. */
+		std::vector<char*> m_vBlocks;
+
+		/** Slots of the destroyed images, to be reused. */
+		std::vector<FaceImage*> m_vFree;
+
+		/** Number of images that fit in the current (last) block. */
+		int m_iCapacity;
+
+		/** Number of slots already used in the current block. */
+		int m_iUsed;
+
+		/** Disables the copy of the pool (the images would be owned by both). */
+		FaceImagePool(const FaceImagePool &);
+		FaceImagePool& operator=(const FaceImagePool &);
+	};
+}
+
+#endif // FACEIMAGEPOOL_H
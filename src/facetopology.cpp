@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "facetopology.h"
+
+#include <QApplication>
+
+#include <algorithm>
+
+using namespace std;
+
+// +-----------------------------------------------------------
+ft::FaceTopology::FaceTopology()
+{
+}
+
+// +-----------------------------------------------------------
+quint64 ft::FaceTopology::edgeKey(int iIDSource, int iIDTarget)
+{
+	return ((quint64) (quint32) qMin(iIDSource, iIDTarget) << 32) | (quint32) qMax(iIDSource, iIDTarget);
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceTopology::connect(int iIDSource, int iIDTarget)
+{
+	quint64 iKey = edgeKey(iIDSource, iIDTarget);
+	if(m_oEdges.contains(iKey))
+		return false;
+
+	m_oEdges.insert(iKey);
+	m_vConnections.push_back(make_pair(iIDSource, iIDTarget));
+	return true;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceTopology::disconnect(int iIDSource, int iIDTarget)
+{
+	if(!m_oEdges.remove(edgeKey(iIDSource, iIDTarget)))
+		return false;
+
+	for(vector<pair<int, int> >::iterator it = m_vConnections.begin(); it != m_vConnections.end(); ++it)
+	{
+		if((it->first == iIDSource && it->second == iIDTarget) || (it->first == iIDTarget && it->second == iIDSource))
+		{
+			m_vConnections.erase(it);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceTopology::isConnected(int iIDSource, int iIDTarget) const
+{
+	return m_oEdges.contains(edgeKey(iIDSource, iIDTarget));
+}
+
+// +-----------------------------------------------------------
+const vector<pair<int, int> > & ft::FaceTopology::connections() const
+{
+	return m_vConnections;
+}
+
+// +-----------------------------------------------------------
+void ft::FaceTopology::merge(const FaceTopology &oOther)
+{
+	for(int i = 0; i < (int) oOther.m_vConnections.size(); i++)
+		connect(oOther.m_vConnections[i].first, oOther.m_vConnections[i].second);
+}
+
+// +-----------------------------------------------------------
+void ft::FaceTopology::removeFeature(int iID)
+{
+	removeFeatures(vector<int>(1, iID));
+}
+
+// +-----------------------------------------------------------
+void ft::FaceTopology::removeFeatures(const vector<int> &vIDs)
+{
+	if(vIDs.empty())
+		return;
+
+	vector<pair<int, int> > vConnections;
+	vConnections.reserve(m_vConnections.size());
+	m_oEdges.clear();
+	for(int i = 0; i < (int) m_vConnections.size(); i++)
+	{
+		pair<int, int> oConn = m_vConnections[i];
+		if(binary_search(vIDs.begin(), vIDs.end(), oConn.first) || binary_search(vIDs.begin(), vIDs.end(), oConn.second))
+			continue;
+
+		// Each ID is decremented by the number of features removed before it
+		oConn.first -= (int) (lower_bound(vIDs.begin(), vIDs.end(), oConn.first) - vIDs.begin());
+		oConn.second -= (int) (lower_bound(vIDs.begin(), vIDs.end(), oConn.second) - vIDs.begin());
+		vConnections.push_back(oConn);
+		m_oEdges.insert(edgeKey(oConn.first, oConn.second));
+	}
+
+	m_vConnections.swap(vConnections);
+}
+
+// +-----------------------------------------------------------
+void ft::FaceTopology::clear()
+{
+	m_vConnections.clear();
+	m_oEdges.clear();
+}
+
+// +-----------------------------------------------------------
+bool ft::FaceTopology::loadFromXML(QXmlStreamReader &oReader, QString &sMsgError)
+{
+	// Check the element name
+	if(oReader.name() != "Connections")
+	{
+		sMsgError = QString(QApplication::translate("FaceTopology", "invalid node name [%1] - expected node '%2'").arg(oReader.name().toString(), "Connections"));
+		return false;
+	}
+
+	FaceTopology oRead;
+	while(oReader.readNextStartElement())
+	{
+		if(oReader.name() != "Connection")
+		{
+			oReader.skipCurrentElement();
+			continue;
+		}
+
+		QXmlStreamAttributes oAttributes = oReader.attributes();
+		bool bSource, bTarget;
+		int iSource = oAttributes.value("source").toInt(&bSource);
+		int iTarget = oAttributes.value("target").toInt(&bTarget);
+		if(!bSource || !bTarget)
+		{
+			sMsgError = QString(QApplication::translate("FaceTopology", "the attribute '%1' does not exist or it contains an invalid value").arg(bSource ? "target" : "source"));
+			return false;
+		}
+
+		oRead.connect(iSource, iTarget);
+		oReader.skipCurrentElement();
+	}
+
+	if(oReader.hasError())
+		return false;
+
+	m_vConnections.swap(oRead.m_vConnections);
+	m_oEdges.swap(oRead.m_oEdges);
+	return true;
+}
+
+// +-----------------------------------------------------------
+void ft::FaceTopology::saveToXML(QXmlStreamWriter &oWriter) const
+{
+	oWriter.writeStartElement("Connections");
+	for(int i = 0; i < (int) m_vConnections.size(); i++)
+	{
+		oWriter.writeEmptyElement("Connection");
+		oWriter.writeAttribute("source", QString::number(m_vConnections[i].first));
+		oWriter.writeAttribute("target", QString::number(m_vConnections[i].second));
+	}
+	oWriter.writeEndElement();
+}
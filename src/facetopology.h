@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FACETOPOLOGY_H
+#define FACETOPOLOGY_H
+
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <QSet>
+
+#include <vector>
+#include <utility>
+
+namespace ft
+{
+	/**
+	 * Connections among the face features of a face annotation dataset. The connections are
+	 * the same in all images of the dataset, so they are stored only once (by the dataset),
+	 * as pairs of feature identifiers (source, target). A connection links the two features
+	 * regardless of its direction.
+	 */
+	class FaceTopology
+	{
+	public:
+		/**
+		 * Class constructor.
+		 */
+		FaceTopology();
+
+		/**
+		 * Connects the two given features (if they are not connected yet).
+		 * @param iIDSource Integer with the ID of the source feature.
+		 * @param iIDTarget Integer with the ID of the target feature.
+		 * @return Boolean indicating if the connection was created (true) or if it
+		 * already existed (false).
+		 */
+		bool connect(int iIDSource, int iIDTarget);
+
+		/**
+		 * Disconnects the two given features (in any direction they were connected).
+		 * @param iIDSource Integer with the ID of the source feature.
+		 * @param iIDTarget Integer with the ID of the target feature.
+		 * @return Boolean indicating if the connection was removed (true) or if it
+		 * did not exist (false).
+		 */
+		bool disconnect(int iIDSource, int iIDTarget);
+
+		/**
+		 * Indicates if the two given features are connected (in any direction).
+		 * @param iIDSource Integer with the ID of the source feature.
+		 * @param iIDTarget Integer with the ID of the target feature.
+		 * @return Boolean indicating if the features are connected (true) or not (false).
+		 */
+		bool isConnected(int iIDSource, int iIDTarget) const;
+
+		/**
+		 * Gets all the connections, in the order they were created.
+		 * @return Std vector with the pairs of feature IDs (source, target) of the connections.
+		 */
+		const std::vector<std::pair<int, int> > & connections() const;
+
+		/**
+		 * Adds to this topology the connections of the given topology that do not exist yet.
+		 * @param oOther FaceTopology with the connections to add.
+		 */
+		void merge(const FaceTopology &oOther);
+
+		/**
+		 * Updates the connections for the removal of the given feature: its connections are
+		 * removed and the IDs of the features after it are decremented (as the features of
+		 * the images are renumbered).
+		 * @param iID Integer with the ID of the feature removed.
+		 */
+		void removeFeature(int iID);
+
+		/**
+		 * Updates the connections for the removal of the given features at once: their
+		 * connections are removed and the IDs of the remaining features are compacted.
+		 * @param vIDs Std vector with the IDs of the features removed, in ascending order
+		 * and without repetitions.
+		 */
+		void removeFeatures(const std::vector<int> &vIDs);
+
+		/**
+		 * Removes all connections.
+		 */
+		void clear();
+
+		/**
+		 * Loads (unserializes) the connections from the given xml stream. The reader must be
+		 * positioned at the start of the connections node, and it is left at the end of that node.
+		 * @param oReader QXmlStreamReader from where to read the connections.
+		 * @param sMsgError QString to receive the error message in case the method fails. It is not
+		 * changed if the failure is an xml syntax error (that is reported by the reader itself).
+		 * @return Boolean indicating if the loading was successful (true) or if it failed (false).
+		 */
+		bool loadFromXML(QXmlStreamReader &oReader, QString &sMsgError);
+
+		/**
+		 * Saves the connections into the given xml stream, as a new connections node
+		 * inside the node currently open in the writer.
+		 * @param oWriter QXmlStreamWriter to receive the node of the connections.
+		 */
+		void saveToXML(QXmlStreamWriter &oWriter) const;
+
+	private:
+
+		/**
+		 * Gets the key of the connection between the two given features in m_oEdges (the
+		 * same in both directions).
+		 * @param iIDSource Integer with the ID of the source feature.
+		 * @param iIDTarget Integer with the ID of the target feature.
+		 * @return Unsigned integer with the smaller ID in the high bits and the larger one
+		 * in the low bits.
+		 */
+		static quint64 edgeKey(int iIDSource, int iIDTarget);
+
+		/** Pairs of feature IDs (source, target) of the connections. */
+		std::vector<std::pair<int, int> > m_vConnections;
+
+		/**
+		 * Keys of the connections (see edgeKey), so a connection is found without scanning
+		 * all of them (the files of the old versions of the format repeat the connections
+		 * in every sample).
+		 */
+		QSet<quint64> m_oEdges;
+	};
+}
+
+#endif // FACETOPOLOGY_H
@@ -27,6 +27,7 @@
 #include <QScrollBar>
 #include <QtMath>
 #include <QGraphicsSceneMouseEvent>
+#include <QSet>
 
 // Scale values for zoom in and out steps
 const double ft::FaceWidget::ZOOM_IN_STEP = 1.25;
@@ -359,10 +360,7 @@ const QList<ft::FaceFeatureNode*>& ft::FaceWidget::getFaceFeatures(int iNumFeats
 		int iDiff = m_lFaceFeatures.size() - iNumFeats;
 
 		if(iDiff > 0)
-		{
-			while(iDiff-- > 0)
-				removeFaceFeature(m_lFaceFeatures.last());
-		}
+			removeFaceFeatures(m_lFaceFeatures.mid(iNumFeats));
 		else if(iDiff < 0)
 		{
 			while(iDiff++ < 0)
@@ -424,20 +422,49 @@ ft::FaceFeatureNode* ft::FaceWidget::addFaceFeature(const QPointF &oPos, bool bG
 // +-----------------------------------------------------------
 void ft::FaceWidget::removeFaceFeature(FaceFeatureNode* pNode)
 {
-	// First, remove all edges connected to the node
-	QList<FaceFeatureEdge*> lEdges = pNode->edges();
-	for(int i = 0; i < lEdges.size(); i++)
-		removeConnection(lEdges[i]);
+	removeFaceFeatures(QList<FaceFeatureNode*>() << pNode);
+}
 
-	// Then, remove the node
-	m_lFaceFeatures.removeOne(pNode);
-	m_pScene->removeItem(pNode);
-	delete pNode;
+// +-----------------------------------------------------------
+void ft::FaceWidget::removeFaceFeatures(const QList<FaceFeatureNode*> &lNodes)
+{
+	if(lNodes.isEmpty())
+		return;
+
+	QSet<FaceFeatureNode*> oRemoved = lNodes.toSet();
 
-	// And adjust the IDs of the remaining features
-	int iID = 0;
+	// First, remove all edges connected to the nodes
+	QList<FaceFeatureEdge*> lConnections;
+	foreach(FaceFeatureEdge *pEdge, m_lConnections)
+	{
+		if(oRemoved.contains(pEdge->sourceNode()) || oRemoved.contains(pEdge->targetNode()))
+		{
+			pEdge->sourceNode()->removeEdge(pEdge);
+			pEdge->targetNode()->removeEdge(pEdge);
+			m_pScene->removeItem(pEdge);
+			delete pEdge;
+		}
+		else
+			lConnections.append(pEdge);
+	}
+	m_lConnections = lConnections;
+
+	// Then, remove the nodes and adjust the IDs of the remaining ones
+	QList<FaceFeatureNode*> lFeatures;
 	foreach(FaceFeatureNode *pNode, m_lFaceFeatures)
-		pNode->setID(iID++);
+	{
+		if(oRemoved.contains(pNode))
+		{
+			m_pScene->removeItem(pNode);
+			delete pNode;
+		}
+		else
+		{
+			pNode->setID(lFeatures.size());
+			lFeatures.append(pNode);
+		}
+	}
+	m_lFaceFeatures = lFeatures;
 }
 
 // +-----------------------------------------------------------
@@ -456,23 +483,31 @@ ft::FaceFeatureEdge* ft::FaceWidget::connectFaceFeatures(FaceFeatureNode* pSourc
 // +-----------------------------------------------------------
 ft::FaceFeatureEdge* ft::FaceWidget::connectFaceFeatures(int iSource, int iTarget)
 {
-	FaceFeatureNode *pSource = NULL, *pTarget = NULL;
-	QList<FaceFeatureNode *> lFeats = getFaceFeatures();
-	foreach(FaceFeatureNode *pFeat, lFeats)
-	{
-		if (pFeat->getID() == iSource)
-			pSource = pFeat;
-		else if (pFeat->getID() == iTarget)
-			pTarget = pFeat;
+	// The nodes are always numbered by their positions in the list
+	if (iSource < 0 || iSource >= m_lFaceFeatures.size() || iTarget < 0 || iTarget >= m_lFaceFeatures.size() || iSource == iTarget)
+		return NULL;
+
+	return connectFaceFeatures(m_lFaceFeatures[iSource], m_lFaceFeatures[iTarget]);
+}
 
-		if (pSource && pTarget)
-			break;
+// +-----------------------------------------------------------
+void ft::FaceWidget::setFaceFeatures(const float *pX, const float *pY, int iNumFeats, const std::vector<std::pair<int, int> > &vConnections)
+{
+	getFaceFeatures(iNumFeats);
+
+	if(pX && pY)
+	{
+		for(int i = 0; i < m_lFaceFeatures.size(); i++)
+		{
+			FaceFeatureNode *pNode = m_lFaceFeatures[i];
+			pNode->setData(0, true); // Indication to avoid emitting position change event
+			pNode->setPos(pX[i], pY[i]);
+			pNode->setData(0, false);
+		}
 	}
 
-	if (pSource && pTarget)
-		return connectFaceFeatures(pSource, pTarget);
-	else
-		return NULL;
+	for(int i = 0; i < (int) vConnections.size(); i++)
+		connectFaceFeatures(vConnections[i].first, vConnections[i].second);
 }
 
 // +-----------------------------------------------------------
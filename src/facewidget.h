@@ -27,6 +27,9 @@
 #include <QMenu>
 #include <QAction>
 
+#include <vector>
+#include <utility>
+
 #include "facefeaturenode.h"
 #include "facefeatureedge.h"
 
@@ -141,6 +144,13 @@ namespace ft
 		 */
 		void removeFaceFeature(FaceFeatureNode* pNode);
 
+		/**
+		 * Removes the given face feature nodes at once (with their edges), renumbering the
+		 * remaining nodes only once.
+		 * @param lNodes QList with the pointers to the face feature nodes to remove.
+		 */
+		void removeFaceFeatures(const QList<FaceFeatureNode*> &lNodes);
+
 		/**
 		 * Adds a new face feature edge connecting two existing nodes.
 		 * @param pSource Pointer to the instance of the first face feature node.
@@ -157,6 +167,17 @@ namespace ft
 		*/
 		FaceFeatureEdge* connectFaceFeatures(int iSource, int iTarget);
 
+		/**
+		 * Updates all the face feature nodes and edges at once: the number of nodes is adjusted,
+		 * the nodes are moved to the given coordinates (without notifying their movement) and
+		 * the given connections are created. Nothing is allocated if the nodes and edges exist.
+		 * @param pX Pointer to the x coordinates of the nodes (or NULL to keep the positions).
+		 * @param pY Pointer to the y coordinates of the nodes (or NULL to keep the positions).
+		 * @param iNumFeats Integer with the number of nodes.
+		 * @param vConnections Std vector with the pairs of node IDs (source, target) to connect.
+		 */
+		void setFaceFeatures(const float *pX, const float *pY, int iNumFeats, const std::vector<std::pair<int, int> > &vConnections);
+
 		/**
 		 * Removes the face feature edge connecting two existing nodes.
 		 * @param pSource Pointer to the instance of the first face feature node.
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gzipdevice.h"
+
+#include <QApplication>
+
+#include <climits>
+
+#include <zlib.h>
+
+namespace
+{
+	/** Size of the buffer for the compressed data. */
+	const int BUFFER_SIZE = 256 * 1024;
+
+	/** Window bits of zlib for the gzip format (when writing). */
+	const int GZIP_WINDOW_BITS = 15 + 16;
+
+	/** Window bits of zlib to detect either the gzip or the zlib format (when reading). */
+	const int AUTO_WINDOW_BITS = 15 + 32;
+}
+
+// +-----------------------------------------------------------
+ft::GzipDevice::GzipDevice(QIODevice *pDevice, QObject *pParent) :
+	QIODevice(pParent)
+{
+	m_pDevice = pDevice;
+	m_pStream = NULL;
+	m_bEnd = false;
+	m_bError = false;
+}
+
+// +-----------------------------------------------------------
+ft::GzipDevice::~GzipDevice()
+{
+	close();
+}
+
+// +-----------------------------------------------------------
+bool ft::GzipDevice::open(OpenMode eMode)
+{
+	if(isOpen() || (eMode != QIODevice::ReadOnly && eMode != QIODevice::WriteOnly))
+		return false;
+
+	m_pStream = new z_stream;
+	m_pStream->zalloc = Z_NULL;
+	m_pStream->zfree = Z_NULL;
+	m_pStream->opaque = Z_NULL;
+	m_pStream->next_in = Z_NULL;
+	m_pStream->avail_in = 0;
+
+	int iRet;
+	if(eMode == QIODevice::ReadOnly)
+		iRet = inflateInit2(m_pStream, AUTO_WINDOW_BITS);
+	else
+		iRet = deflateInit2(m_pStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY);
+
+	if(iRet != Z_OK)
+	{
+		delete m_pStream;
+		m_pStream = NULL;
+		return false;
+	}
+
+	m_oBuffer.resize(BUFFER_SIZE);
+	m_bEnd = false;
+	m_bError = false;
+	return QIODevice::open(eMode);
+}
+
+// +-----------------------------------------------------------
+void ft::GzipDevice::close()
+{
+	if(!m_pStream)
+		return;
+
+	if(openMode() == QIODevice::WriteOnly)
+	{
+		if(!m_bError)
+			deflateBuffer(Z_FINISH);
+		deflateEnd(m_pStream);
+	}
+	else
+		inflateEnd(m_pStream);
+
+	delete m_pStream;
+	m_pStream = NULL;
+	m_oBuffer.clear();
+	QIODevice::close();
+}
+
+// +-----------------------------------------------------------
+bool ft::GzipDevice::isSequential() const
+{
+	return true;
+}
+
+// +-----------------------------------------------------------
+bool ft::GzipDevice::atEnd() const
+{
+	return (m_bEnd || m_bError) && QIODevice::bytesAvailable() == 0;
+}
+
+// +-----------------------------------------------------------
+bool ft::GzipDevice::hasError() const
+{
+	return m_bError;
+}
+
+// +-----------------------------------------------------------
+qint64 ft::GzipDevice::readData(char *pData, qint64 iMaxSize)
+{
+	if(m_bError)
+		return -1;
+
+	m_pStream->next_out = (Bytef *) pData;
+	m_pStream->avail_out = (uInt) qMin(iMaxSize, (qint64) UINT_MAX);
+	uInt iRequested = m_pStream->avail_out;
+
+	while(m_pStream->avail_out > 0 && !m_bEnd)
+	{
+		// Read more compressed data when all of it was consumed
+		if(m_pStream->avail_in == 0)
+		{
+			qint64 iRead = m_pDevice->read(m_oBuffer.data(), m_oBuffer.size());
+			if(iRead <= 0)
+			{
+				setError(QApplication::translate("GzipDevice", "the compressed data is incomplete"));
+				break;
+			}
+			m_pStream->next_in = (Bytef *) m_oBuffer.data();
+			m_pStream->avail_in = (uInt) iRead;
+		}
+
+		int iRet = inflate(m_pStream, Z_NO_FLUSH);
+		if(iRet == Z_STREAM_END)
+		{
+			// Concatenated gzip members are read as a single stream
+			if(m_pStream->avail_in > 0 || !m_pDevice->atEnd())
+				inflateReset(m_pStream);
+			else
+				m_bEnd = true;
+		}
+		else if(iRet != Z_OK && iRet != Z_BUF_ERROR)
+		{
+			setError(QApplication::translate("GzipDevice", "the compressed data is corrupted"));
+			break;
+		}
+	}
+
+	qint64 iRead = iRequested - m_pStream->avail_out;
+	if(iRead == 0 && m_bError)
+		return -1;
+	return iRead;
+}
+
+// +-----------------------------------------------------------
+qint64 ft::GzipDevice::writeData(const char *pData, qint64 iSize)
+{
+	if(m_bError)
+		return -1;
+
+	// The data is given to zlib in pieces that fit its counters
+	qint64 iWritten = 0;
+	while(iWritten < iSize)
+	{
+		uInt iPiece = (uInt) qMin(iSize - iWritten, (qint64) UINT_MAX);
+		m_pStream->next_in = (Bytef *) (pData + iWritten);
+		m_pStream->avail_in = iPiece;
+		if(!deflateBuffer(Z_NO_FLUSH))
+			return -1;
+		iWritten += iPiece;
+	}
+
+	return iWritten;
+}
+
+// +-----------------------------------------------------------
+bool ft::GzipDevice::deflateBuffer(int iFlush)
+{
+	int iRet;
+	do
+	{
+		m_pStream->next_out = (Bytef *) m_oBuffer.data();
+		m_pStream->avail_out = (uInt) m_oBuffer.size();
+		iRet = deflate(m_pStream, iFlush);
+		if(iRet == Z_STREAM_ERROR)
+		{
+			setError(QApplication::translate("GzipDevice", "the data could not be compressed"));
+			return false;
+		}
+
+		qint64 iSize = m_oBuffer.size() - m_pStream->avail_out;
+		if(iSize > 0 && m_pDevice->write(m_oBuffer.constData(), iSize) != iSize)
+		{
+			setError(m_pDevice->errorString());
+			return false;
+		}
+	} while(m_pStream->avail_out == 0 || (iFlush == Z_FINISH && iRet != Z_STREAM_END));
+
+	return true;
+}
+
+// +-----------------------------------------------------------
+void ft::GzipDevice::setError(const QString &sError)
+{
+	m_bError = true;
+	setErrorString(sError);
+}
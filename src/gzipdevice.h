@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GZIPDEVICE_H
+#define GZIPDEVICE_H
+
+#include <QIODevice>
+#include <QByteArray>
+
+struct z_stream_s;
+
+namespace ft
+{
+	/**
+	 * Sequential device that compresses (in gzip format) the data written to it into another
+	 * device, or decompresses the data read from another device. The data is (de)compressed as
+	 * it streams through a small buffer, so a file is never completely held in memory. The
+	 * device can be opened either for reading or for writing, but not for both.
+	 */
+	class GzipDevice : public QIODevice
+	{
+	public:
+		/**
+		 * Class constructor.
+		 * @param pDevice Instance of the QIODevice with the compressed data, that must already
+		 * be open in the same mode this device is opened.
+		 * @param pParent Instance of the object that will be the parent of this device.
+		 */
+		GzipDevice(QIODevice *pDevice, QObject *pParent = 0);
+
+		/**
+		 * Class destructor.
+		 */
+		virtual ~GzipDevice();
+
+		/**
+		 * Opens the device.
+		 * @param eMode Open mode, that must be either QIODevice::ReadOnly or QIODevice::WriteOnly.
+		 * @return Boolean indicating if the device was opened (true) or not (false).
+		 */
+		bool open(OpenMode eMode);
+
+		/**
+		 * Closes the device. When writing, the compressed stream is finished (the error to
+		 * finish it can be queried with hasError).
+		 */
+		void close();
+
+		/**
+		 * Indicates that this device is sequential.
+		 * @return Always true.
+		 */
+		bool isSequential() const;
+
+		/**
+		 * Indicates if all the data was read from the device.
+		 * @return Boolean indicating if the end of the compressed stream was reached and all
+		 * its data was read (true) or not (false).
+		 */
+		bool atEnd() const;
+
+		/**
+		 * Indicates if there was an error in the compressed stream or in the underlying device.
+		 * @return Boolean indicating if an error happened (true) or not (false).
+		 */
+		bool hasError() const;
+
+	protected:
+
+		/**
+		 * Reads decompressed data from the device.
+		 * @param pData Pointer to the buffer to receive the data.
+		 * @param iMaxSize Maximum number of bytes to read.
+		 * @return Number of bytes read, or -1 in case of error.
+		 */
+		qint64 readData(char *pData, qint64 iMaxSize);
+
+		/**
+		 * Writes data to be compressed to the device.
+		 * @param pData Pointer to the data to write.
+		 * @param iSize Number of bytes to write.
+		 * @return Number of bytes written, or -1 in case of error.
+		 */
+		qint64 writeData(const char *pData, qint64 iSize);
+
+		/**
+		 * Writes to the underlying device the data compressed while its output buffer is
+		 * not enough.
+		 * @param iFlush Flush mode of zlib (Z_NO_FLUSH or Z_FINISH).
+		 * @return Boolean indicating if the data was written (true) or not (false).
+		 */
+		bool deflateBuffer(int iFlush);
+
+		/**
+		 * Sets the error state of the device.
+		 * @param sError QString with the error message.
+		 */
+		void setError(const QString &sError);
+
+	private:
+
+		/** Device with the compressed data. */
+		QIODevice *m_pDevice;
+
+		/** State of zlib (NULL if the device is not open). */
+		z_stream_s *m_pStream;
+
+		/** Buffer for the compressed data. */
+		QByteArray m_oBuffer;
+
+		/** Indication if the end of the compressed stream was reached (when reading). */
+		bool m_bEnd;
+
+		/** Indication if an error happened. */
+		bool m_bError;
+	};
+}
+
+#endif // GZIPDEVICE_H
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "imagecache.h"
+
+#include <QHash>
+#include <QPair>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QFileInfo>
+#include <QDateTime>
+
+#include <list>
+
+using namespace std;
+
+// Default memory budget of the cache (256 MB)
+const qint64 ft::ImageCache::DEFAULT_BUDGET = 256 * 1024 * 1024;
+
+namespace
+{
+	/** Identification of an image: its file name and time of last modification. */
+	typedef QPair<QString, qint64> ImageKey;
+
+	/** Image in the cache. */
+	struct CacheEntry
+	{
+		/** Decoded image data. */
+		QImage oImage;
+
+		/** Memory used by the image, in bytes. */
+		qint64 iBytes;
+
+		/** Position of the image in the list of uses. */
+		list<ImageKey>::iterator itUse;
+	};
+
+	/** Images in the cache, indexed by their identification. */
+	QHash<ImageKey, CacheEntry> g_oEntries;
+
+	/** Identifications of the images in the cache, from the least to the most recently used. */
+	list<ImageKey> g_lUses;
+
+	/** Memory used by the images in the cache. */
+	qint64 g_iBytes = 0;
+
+	/** Memory budget of the cache. */
+	qint64 g_iBudget = ft::ImageCache::DEFAULT_BUDGET;
+
+	/** Number of requests of images served from the cache. */
+	qint64 g_iHits = 0;
+
+	/** Number of requests of images that had to be decoded. */
+	qint64 g_iMisses = 0;
+
+	/** Lock that protects the cache. */
+	QMutex g_oMutex;
+
+	/**
+	 * Gets the identification of the image in the given file.
+	 * @param sFileName QString with the complete file name of the image.
+	 * @return ImageKey with the identification of the image.
+	 */
+	ImageKey makeKey(const QString &sFileName)
+	{
+		return ImageKey(sFileName, QFileInfo(sFileName).lastModified().toMSecsSinceEpoch());
+	}
+
+	/**
+	 * Evicts the least recently used images that are only referenced by the cache, until the
+	 * memory used fits the budget (or no other image can be evicted). The cache must be locked.
+	 */
+	void trim()
+	{
+		list<ImageKey>::iterator it = g_lUses.begin();
+		while(g_iBytes > g_iBudget && it != g_lUses.end())
+		{
+			QHash<ImageKey, CacheEntry>::iterator itEntry = g_oEntries.find(*it);
+			if(!itEntry.value().oImage.isDetached())
+			{
+				// Still used outside the cache
+				++it;
+				continue;
+			}
+
+			g_iBytes -= itEntry.value().iBytes;
+			g_oEntries.erase(itEntry);
+			it = g_lUses.erase(it);
+		}
+	}
+}
+
+// +-----------------------------------------------------------
+QImage ft::ImageCache::image(const QString &sFileName)
+{
+	ImageKey oKey = makeKey(sFileName);
+
+	{
+		QMutexLocker oLocker(&g_oMutex);
+		QHash<ImageKey, CacheEntry>::iterator it = g_oEntries.find(oKey);
+		if(it != g_oEntries.end())
+		{
+			g_iHits++;
+			g_lUses.splice(g_lUses.end(), g_lUses, it.value().itUse);
+			return it.value().oImage;
+		}
+		g_iMisses++;
+	}
+
+	// The image is decoded without locking the cache, so other threads are not blocked
+	QImage oImage(sFileName);
+	if(oImage.isNull())
+		return oImage;
+
+	QMutexLocker oLocker(&g_oMutex);
+	if(g_iBudget <= 0)
+		return oImage;
+
+	// Another thread might have decoded the same image in the meantime
+	QHash<ImageKey, CacheEntry>::iterator it = g_oEntries.find(oKey);
+	if(it != g_oEntries.end())
+	{
+		g_lUses.splice(g_lUses.end(), g_lUses, it.value().itUse);
+		return it.value().oImage;
+	}
+
+	CacheEntry oEntry;
+	oEntry.oImage = oImage;
+	oEntry.iBytes = (qint64) oImage.bytesPerLine() * oImage.height();
+	oEntry.itUse = g_lUses.insert(g_lUses.end(), oKey);
+	g_oEntries.insert(oKey, oEntry);
+	g_iBytes += oEntry.iBytes;
+
+	// The new image is referenced by the caller, so it is not evicted
+	trim();
+	return oImage;
+}
+
+// +-----------------------------------------------------------
+void ft::ImageCache::setBudget(qint64 iBytes)
+{
+	QMutexLocker oLocker(&g_oMutex);
+	g_iBudget = iBytes;
+	trim();
+}
+
+// +-----------------------------------------------------------
+qint64 ft::ImageCache::budget()
+{
+	QMutexLocker oLocker(&g_oMutex);
+	return g_iBudget;
+}
+
+// +-----------------------------------------------------------
+qint64 ft::ImageCache::memoryUsed()
+{
+	QMutexLocker oLocker(&g_oMutex);
+	return g_iBytes;
+}
+
+// +-----------------------------------------------------------
+double ft::ImageCache::hitRate()
+{
+	QMutexLocker oLocker(&g_oMutex);
+	qint64 iTotal = g_iHits + g_iMisses;
+	return iTotal ? (double) g_iHits / iTotal : 0.0;
+}
+
+// +-----------------------------------------------------------
+void ft::ImageCache::clear()
+{
+	QMutexLocker oLocker(&g_oMutex);
+	g_oEntries.clear();
+	g_lUses.clear();
+	g_iBytes = 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <QString>
+#include <QImage>
+
+namespace ft
+{
+	/**
+	 * Cache of the decoded face images, shared by the whole application (so an image used by
+	 * several datasets, open in different tabs, is decoded and kept in memory only once). The
+	 * images are identified by their file names and times of last modification, so a file
+	 * changed on disk is decoded again. The images are implicitly shared (reference counted),
+	 * so the ones still used outside the cache are never evicted (that would free nothing);
+	 * the others are evicted from the least recently used when the memory budget is exceeded.
+	 * The cache can be used from any thread.
+	 */
+	class ImageCache
+	{
+	public:
+		/**
+		 * Gets the decoded image of the given file, decoding it if it is not in the cache.
+		 * @param sFileName QString with the complete file name of the image.
+		 * @return QImage with the image data, or a null QImage if the file could not be read.
+		 */
+		static QImage image(const QString &sFileName);
+
+		/**
+		 * Defines the amount of memory that can be used by the images in the cache.
+		 * @param iBytes Integer with the budget in bytes (0 disables the cache).
+		 */
+		static void setBudget(qint64 iBytes);
+
+		/**
+		 * Gets the amount of memory that can be used by the images in the cache.
+		 * @return Integer with the budget in bytes.
+		 */
+		static qint64 budget();
+
+		/**
+		 * Gets the amount of memory currently used by the images in the cache.
+		 * @return Integer with the memory used in bytes.
+		 */
+		static qint64 memoryUsed();
+
+		/**
+		 * Gets the rate of the requests of images served from the cache (without reading
+		 * and decoding the image file), since the application started.
+		 * @return Double with the hit rate in [0, 1] (0 if no image was requested).
+		 */
+		static double hitRate();
+
+		/**
+		 * Removes all the images from the cache.
+		 */
+		static void clear();
+
+		/** Default memory budget of the cache, in bytes. */
+		static const qint64 DEFAULT_BUDGET;
+	};
+}
+
+#endif // IMAGECACHE_H
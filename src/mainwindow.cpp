@@ -24,6 +24,7 @@
 #include "facefitconfig.h"
 #include "utils.h"
 #include "application.h"
+#include "imagecache.h"
 
 #include <vector>
 
@@ -35,6 +36,7 @@
 #include <QMessageBox>
 #include <QTemporaryFile>
 #include <QMenu>
+#include <QScrollBar>
 
 using namespace std;
 
@@ -82,6 +84,15 @@ ft::MainWindow::MainWindow(QWidget *pParent) :
 	m_pViewButton->setIcon(QIcon(":/icons/viewicons")); // By default display the image thumbnails
 	ui->treeImages->setVisible(false);
 
+	// Track the images displayed in the view of thumbnails (scrolling and resizing)
+	connect(ui->listImages->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateVisibleImages()));
+	connect(ui->listImages->horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateVisibleImages()));
+	ui->listImages->viewport()->installEventFilter(this);
+
+	// Add the statistics of the image cache to the status bar
+	m_pImageCacheLabel = new QLabel(ui->statusBar);
+	ui->statusBar->addPermanentWidget(m_pImageCacheLabel);
+
 	// Default path for file dialogs is the standard documents path
 	m_sLastPathUsed = QDir::toNativeSeparators(QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)) + QDir::separator();
 
@@ -121,6 +132,7 @@ ft::MainWindow::~MainWindow()
 	oSettings.setValue("faceFitPath", m_sFaceFitPath);
 	oSettings.setValue("dlibFaceDetModelFilename", m_sDlibFaceDetModelFilename);
 	oSettings.setValue("dlibLandmarkLocModelFilename", m_sDlibLandmarkLocModelFilename);
+	oSettings.setValue("imageCacheBudgetMB", ImageCache::budget() / (1024 * 1024));
 
     if(m_pAbout)
         delete m_pAbout;
@@ -137,10 +149,11 @@ void ft::MainWindow::closeEvent(QCloseEvent *pEvent)
 	QList<ChildWindow*> lModified;
 	ChildWindow *pChild;
 
-	// Get the list of modified child windows
+	// Get the list of modified child windows (after the saves in progress are finished)
 	for(int i = 0; i < ui->tabWidget->count(); i++)
 	{
 		pChild = (ChildWindow*) ui->tabWidget->widget(i);
+		pChild->waitForSave();
 		if(pChild->isWindowModified())
 			lModified.append(pChild);
 	}
@@ -203,6 +216,9 @@ void ft::MainWindow::showEvent(QShowEvent *pEvent)
 	vValue = oSettings.value("dlibLandmarkLocModelFilename");
 	if (vValue.isValid())
 		m_sDlibLandmarkLocModelFilename = vValue.toString();
+	vValue = oSettings.value("imageCacheBudgetMB");
+	if (vValue.isValid())
+		ImageCache::setBudget(vValue.toLongLong() * 1024 * 1024);
 
 	// Update UI elements
 	updateUI();
@@ -221,24 +237,31 @@ void ft::MainWindow::on_actionNew_triggered()
 // +-----------------------------------------------------------
 void ft::MainWindow::on_actionOpen_triggered()
 {
-    QString sFile = QFileDialog::getOpenFileName(this, tr("Open face annotation dataset..."), m_sLastPathUsed, tr("Face Annotation Dataset files (*.fad);; All files (*.*)"));
+    QString sFile = QFileDialog::getOpenFileName(this, tr("Open face annotation dataset..."), m_sLastPathUsed, tr("Face Annotation Dataset files (*.fad *.fadb *.fad.gz *.fadb.gz);; Binary Face Annotation Dataset files (*.fadb);; Compressed Face Annotation Dataset files (*.fad.gz *.fadb.gz);; All files (*.*)"));
 	openFile(sFile);
 }
 
+// +-----------------------------------------------------------
+void ft::MainWindow::on_actionOpenLazily_triggered()
+{
+    QString sFile = QFileDialog::getOpenFileName(this, tr("Open face annotation dataset lazily..."), m_sLastPathUsed, tr("Face Annotation Dataset files (*.fad);; All files (*.*)"));
+	openFile(sFile, true);
+}
+
 // +-----------------------------------------------------------
 void ft::MainWindow::on_actionSave_triggered()
 {
-	saveCurrentFile();
+	saveCurrentFile(false, true);
 }
 
 // +-----------------------------------------------------------
 void ft::MainWindow::on_actionSaveAs_triggered()
 {
-	saveCurrentFile(true);
+	saveCurrentFile(true, true);
 }
 
 // +-----------------------------------------------------------
-bool ft::MainWindow::openFile(const QString & sFile_)
+bool ft::MainWindow::openFile(const QString & sFile_, bool bLazy)
 {
 	if (!sFile_.length())
 		return false;
@@ -256,13 +279,29 @@ bool ft::MainWindow::openFile(const QString & sFile_)
 		ChildWindow *pChild = createChildWindow(sFile, false);
 
 		QString sMsg;
-		if (!pChild->loadFromFile(sFile, sMsg))
+		if (!pChild->loadFromFile(sFile, sMsg, bLazy))
 		{
 			destroyChildWindow(pChild);
 			QMessageBox::warning(this, tr("Fail to load the face annotation dataset"), tr("It was not possible to open the face annotation dataset:\n%1").arg(sMsg), QMessageBox::Ok);
 			return false;
 		}
 
+		// A journal is only left behind if the application was not properly closed
+		if (EditJournal::exists(sFile))
+		{
+			QString sQuestion = tr("The face annotation dataset [%1] was not properly closed. Do you wish to recover the changes made after it was last saved?").arg(QFileInfo(sFile).baseName());
+			if (QMessageBox::question(this, tr("Recover changes"), sQuestion, QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes)
+			{
+				if (!pChild->recoverEdits(sMsg))
+				{
+					EditJournal::remove(sFile);
+					QMessageBox::warning(this, tr("Fail to recover the changes"), tr("It was not possible to recover the changes in the face annotation dataset:\n%1").arg(sMsg), QMessageBox::Ok);
+				}
+			}
+			else
+				EditJournal::remove(sFile);
+		}
+
 		if (pChild->dataModel()->rowCount() > 0)
 			pChild->selectionModel()->setCurrentIndex(pChild->dataModel()->index(0, 0), QItemSelectionModel::Select);
 		updateUI();
@@ -272,7 +311,7 @@ bool ft::MainWindow::openFile(const QString & sFile_)
 }
 
 // +-----------------------------------------------------------
-bool ft::MainWindow::saveCurrentFile(bool bAskForFileName)
+bool ft::MainWindow::saveCurrentFile(bool bAskForFileName, bool bInBackground)
 {
 	ChildWindow *pChild = (ChildWindow*) ui->tabWidget->currentWidget();
 	if(!pChild || (!bAskForFileName && !pChild->isWindowModified()))
@@ -280,8 +319,14 @@ bool ft::MainWindow::saveCurrentFile(bool bAskForFileName)
 
 	if(bAskForFileName)
 	{
-		QString sFileName = QFileDialog::getSaveFileName(this, tr("Save face annotation dataset..."), windowFilePath(), tr("Face Annotation Dataset files (*.fad);; All files (*.*)"));
-		if(sFileName.length())
+		QString sFileName = QFileDialog::getSaveFileName(this, tr("Save face annotation dataset..."), windowFilePath(), tr("Face Annotation Dataset files (*.fad);; Binary Face Annotation Dataset files (*.fadb);; Compressed Face Annotation Dataset files (*.fad.gz *.fadb.gz);; All files (*.*)"));
+		if(sFileName.length() && bInBackground)
+		{
+			m_sLastPathUsed = QFileInfo(sFileName).absolutePath();
+			pChild->saveInBackground(sFileName);
+			return true;
+		}
+		else if(sFileName.length())
 		{
 			QString sMsg;
 			if(!pChild->saveToFile(sFileName, sMsg))
@@ -300,7 +345,12 @@ bool ft::MainWindow::saveCurrentFile(bool bAskForFileName)
 	{
 		// Force the user to chose a file name if the dataset has not yet been saved
 		if(pChild->property("new").toBool())
-			return saveCurrentFile(true);
+			return saveCurrentFile(true, bInBackground);
+		else if(bInBackground)
+		{
+			pChild->saveInBackground(pChild->windowFilePath());
+			return true;
+		}
 		else
 		{
 			QString sMsg;
@@ -339,7 +389,7 @@ void ft::MainWindow::on_actionImportImageDirPts_triggered()
 		// add images
 		for (int i = 0; i < lsFiles.size(); ++i)
 			lsFiles[i] = path + '/' + lsFiles[i];
-		pChild->dataModel()->addImages(lsFiles);
+		pChild->addImages(lsFiles);
 
 		// load pts files
 		FaceDataset * ds = pChild->dataModel()->getFaceDataset();
@@ -356,7 +406,7 @@ void ft::MainWindow::on_actionImportImageDirPts_triggered()
 			{
 				if (n_feat == -1)
 				{
-					n_feat = img->getFeatures().size();
+					n_feat = img->numFeatures();
 					ds->setNumFeatures(n_feat);
 				}
 			}
@@ -391,7 +441,7 @@ void ft::MainWindow::on_actionExportPts_triggered()
 		FaceImage * img = ds->getImage(i);
 		if (!img)
 			continue;
-		if (!img->savePtsFile(true))
+		if (!img->savePtsFile())
 		{
 			if (QMessageBox::critical(this, tr("Error"), tr("Failed to save PTS file for '%1'\nContinue to save PTS files?").arg(img->fileName()),
 				QMessageBox::Ok | QMessageBox::Cancel) == QMessageBox::Cancel)
@@ -661,6 +711,8 @@ void ft::MainWindow::on_tabCloseRequested(int iTabIndex)
 {
 	ChildWindow* pChild = (ChildWindow*) ui->tabWidget->widget(iTabIndex);
 
+	// A save in progress may leave the dataset without pending changes
+	pChild->waitForSave();
 	if(pChild->isWindowModified())
 	{
 		QString sMsg = tr("There are pending changes in the face annotation dataset named [%1]. Do you wish to save it before closing?").arg(QFileInfo(pChild->windowFilePath()).baseName());
@@ -702,7 +754,7 @@ void ft::MainWindow::on_actionAddImage_triggered()
 	if(lsFiles.size())
 	{
 		m_sLastPathUsed = QFileInfo(lsFiles[0]).absolutePath();
-		pChild->dataModel()->addImages(lsFiles);
+		pChild->addImages(lsFiles);
 		if(!pChild->selectionModel()->currentIndex().isValid())
 			pChild->selectionModel()->setCurrentIndex(pChild->dataModel()->index(0, 0), QItemSelectionModel::Select);
 	}
@@ -728,7 +780,7 @@ void ft::MainWindow::on_actionRemoveImage_triggered()
 			QList<int> lIndexes;
 			for(int i = 0; i < lsSelected.size(); i++)
 				lIndexes.append(lsSelected[i].row());
-			pChild->dataModel()->removeImages(lIndexes);
+			pChild->removeImages(lIndexes);
 		}
 	}
 }
@@ -826,6 +878,16 @@ void ft::MainWindow::on_actionDisconnectFeatures_triggered()
 	pChild->disconnectFeatures();
 }
 
+// +-----------------------------------------------------------
+void ft::MainWindow::on_actionCompactCoordinates_triggered(bool bChecked)
+{
+	ChildWindow *pChild = (ChildWindow*) ui->tabWidget->currentWidget();
+	if(!pChild)
+		return;
+
+	pChild->setCompactCoordinates(bChecked);
+}
+
 // +-----------------------------------------------------------
 void ft::MainWindow::showStatusMessage(const QString &sMsg, const int iTimeout)
 {
@@ -863,6 +925,8 @@ void ft::MainWindow::setImageListView(QString sType)
 		ui->treeImages->setVisible(false);
 		ui->listImages->setVisible(true);
 	}
+
+	updateUI();
 }
 
 // +-----------------------------------------------------------
@@ -874,6 +938,36 @@ void ft::MainWindow::toggleImageListView()
 		setImageListView("details");
 }
 
+// +-----------------------------------------------------------
+void ft::MainWindow::updateVisibleImages()
+{
+	ChildWindow *pChild = (ChildWindow*) ui->tabWidget->currentWidget();
+	if(!pChild || ui->listImages->model() != pChild->dataModel())
+		return;
+
+	// Look for the items at the corners of the viewport, stepping inwards by one cell
+	// of the grid while the corner falls in an empty area (i.e. the end of the last row)
+	QRect oArea = ui->listImages->viewport()->rect();
+	QSize oCell = ui->listImages->gridSize();
+	if(!oCell.isValid())
+		oCell = QSize(1, 1);
+
+	QModelIndex oFirst = ui->listImages->indexAt(oArea.topLeft());
+	for(QPoint oPos = oArea.topLeft(); !oFirst.isValid() && oPos.y() <= oArea.bottom(); oPos.ry() += oCell.height())
+		for(oPos.rx() = oArea.left(); !oFirst.isValid() && oPos.x() <= oArea.right(); oPos.rx() += oCell.width())
+			oFirst = ui->listImages->indexAt(oPos);
+
+	QModelIndex oLast = ui->listImages->indexAt(oArea.bottomRight());
+	for(QPoint oPos = oArea.bottomRight(); !oLast.isValid() && oPos.y() >= oArea.top(); oPos.ry() -= oCell.height())
+		for(oPos.rx() = oArea.right(); !oLast.isValid() && oPos.x() >= oArea.left(); oPos.rx() -= oCell.width())
+			oLast = ui->listImages->indexAt(oPos);
+
+	if(oFirst.isValid() && oLast.isValid())
+		pChild->dataModel()->setVisibleRows(oFirst.row(), oLast.row());
+	else
+		pChild->dataModel()->setVisibleRows(-1, -1);
+}
+
 // +-----------------------------------------------------------
 void ft::MainWindow::onChildUIUpdated(const QString sImageName, const int iZoomLevel)
 {
@@ -890,6 +984,13 @@ void ft::MainWindow::onChildUIUpdated(const QString sImageName, const int iZoomL
 	updateUI();
 }
 
+// +-----------------------------------------------------------
+void ft::MainWindow::onChildSaveFinished(const bool bSuccess, const QString sMsgError)
+{
+	if(!bSuccess)
+		QMessageBox::warning(this, tr("Fail to save the face annotation dataset"), tr("It was not possible to save the face annotation dataset:\n%1").arg(sMsgError), QMessageBox::Ok);
+}
+
 // +-----------------------------------------------------------
 void ft::MainWindow::updateUI()
 {
@@ -901,6 +1002,9 @@ void ft::MainWindow::updateUI()
 	bool bItemsSelected = bFileOpened && (pChild->selectionModel()->currentIndex().isValid() || pChild->selectionModel()->selectedIndexes().size() > 0);
 	bool bFileNotNew = bFileOpened && !pChild->property("new").toBool();
 
+	// Images and features can not be added or removed while the dataset is saved
+	bool bFileSaving = bFileOpened && pChild->isSaving();
+
 	QList<FaceFeatureNode*> lFeats;
 	QList<FaceFeatureEdge*> lConns;
 	if(bFileOpened)
@@ -920,6 +1024,10 @@ void ft::MainWindow::updateUI()
 		ui->listImages->setSelectionModel(pChild->selectionModel());
 		ui->treeImages->setModel(pChild->dataModel());
 		ui->treeImages->setSelectionModel(pChild->selectionModel());
+
+		// The thumbnails are only displayed in the icons view
+		updateVisibleImages();
+		pChild->dataModel()->setThumbnailsEnabled(!ui->listImages->isHidden());
 	}
 	else
 	{
@@ -928,16 +1036,18 @@ void ft::MainWindow::updateUI()
 	}
 
 	// Update the UI availability
-	ui->actionSave->setEnabled(bFileChanged);
-	ui->actionSaveAs->setEnabled(bFileNotNew);
-	ui->actionImportImageDirPts->setEnabled(bFileOpened);
+	ui->actionSave->setEnabled(bFileChanged && !bFileSaving);
+	ui->actionSaveAs->setEnabled(bFileNotNew && !bFileSaving);
+	ui->actionImportImageDirPts->setEnabled(bFileOpened && !bFileSaving);
 	ui->actionExportPts->setEnabled(bFileOpened);
-	ui->actionAddImage->setEnabled(bFileOpened);
-	ui->actionRemoveImage->setEnabled(bItemsSelected);
-	ui->actionAddFeature->setEnabled(bFileOpened);
-	ui->actionRemoveFeature->setEnabled(bFeaturesSelected);
-	ui->actionConnectFeatures->setEnabled(bFeaturesConnectable);
-	ui->actionDisconnectFeatures->setEnabled(bConnectionsSelected);
+	ui->actionAddImage->setEnabled(bFileOpened && !bFileSaving);
+	ui->actionRemoveImage->setEnabled(bItemsSelected && !bFileSaving);
+	ui->actionAddFeature->setEnabled(bFileOpened && !bFileSaving);
+	ui->actionRemoveFeature->setEnabled(bFeaturesSelected && !bFileSaving);
+	ui->actionConnectFeatures->setEnabled(bFeaturesConnectable && !bFileSaving);
+	ui->actionDisconnectFeatures->setEnabled(bConnectionsSelected && !bFileSaving);
+	ui->actionCompactCoordinates->setEnabled(bFileOpened && !bFileSaving);
+	ui->actionCompactCoordinates->setChecked(bFileOpened && pChild->dataModel()->getFaceDataset()->isCompactCoordinates());
 	ui->actionFitLandmarks->setEnabled(bItemsSelected);
 	ui->actionExportPointsFile->setEnabled(bItemsSelected);
 	ui->actionDlibFitLandmarks->setEnabled(bItemsSelected);
@@ -961,6 +1071,8 @@ void ft::MainWindow::updateUI()
 		pChild->setDisplayFeatureIDs(ui->actionShowFeatures->isChecked() && ui->actionShowFeatureIDs->isChecked());
 	}
 
+	// Statistics of the image cache
+	m_pImageCacheLabel->setText(QString(tr("Image cache: %1% hits, %2 MB")).arg(qRound(100 * ImageCache::hitRate())).arg(ImageCache::memoryUsed() / (1024 * 1024)));
 }
 
 // +-----------------------------------------------------------
@@ -1029,6 +1141,14 @@ void ft::MainWindow::keyPressEvent(QKeyEvent *pEvent)
     }
 }
 
+// +-----------------------------------------------------------
+bool ft::MainWindow::eventFilter(QObject *pObject, QEvent *pEvent)
+{
+	if(pObject == ui->listImages->viewport() && pEvent->type() == QEvent::Resize)
+		updateVisibleImages();
+	return QMainWindow::eventFilter(pObject, pEvent);
+}
+
 // +-----------------------------------------------------------
 ft::ChildWindow* ft::MainWindow::createChildWindow(QString sFileName, bool bModified)
 {
@@ -1049,6 +1169,7 @@ ft::ChildWindow* ft::MainWindow::createChildWindow(QString sFileName, bool bModi
 	connect(pChild, SIGNAL(onUIUpdated(const QString, const int)), this, SLOT(onChildUIUpdated(const QString, const int)));
 	connect(pChild, SIGNAL(onDataModified()), this, SLOT(onUpdateUI()));
 	connect(pChild, SIGNAL(onFeaturesSelectionChanged()), this, SLOT(onUpdateUI()));
+	connect(pChild, SIGNAL(onSaveFinished(const bool, const QString)), this, SLOT(onChildSaveFinished(const bool, const QString)));
 
 	// Create the context menu for the features editor, using the same actions from the main window
 	QMenu *pContextMenu = new QMenu(pChild);
@@ -1068,12 +1189,16 @@ ft::ChildWindow* ft::MainWindow::createChildWindow(QString sFileName, bool bModi
 // +-----------------------------------------------------------
 void ft::MainWindow::destroyChildWindow(ChildWindow *pChild)
 {
+	// A save in progress is completed before the window is destroyed
+	pChild->waitForSave();
+
 	int iTabIndex = ui->tabWidget->indexOf(pChild);
 	ui->tabWidget->removeTab(iTabIndex);
 
 	disconnect(pChild, SIGNAL(onUIUpdated(const QString, const int)), this, SLOT(onChildUIUpdated(const QString, const int)));
 	disconnect(pChild, SIGNAL(onDataModified()), this, SLOT(onUpdateUI()));
 	disconnect(pChild, SIGNAL(onFeaturesSelectionChanged()), this, SLOT(onUpdateUI()));
+	disconnect(pChild, SIGNAL(onSaveFinished(const bool, const QString)), this, SLOT(onChildSaveFinished(const bool, const QString)));
 
 	delete pChild;
 }
\ No newline at end of file
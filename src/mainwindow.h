@@ -23,6 +23,7 @@
 
 #include <QMainWindow>
 #include <QProcess>
+#include <QLabel>
 
 #include "aboutwindow.h"
 #include "childwindow.h"
@@ -59,9 +60,10 @@ namespace ft
 		/**
 		 * Open a file.
 		 * @param sFile Filename.
+		 * @param bLazy Whether the image samples are only parsed from the file when first accessed.
 		 * @return Boolean indicating if file was opened successfully.
 		 */
-		bool openFile(const QString &sFile);
+		bool openFile(const QString &sFile, bool bLazy = false);
 
 	protected:
 
@@ -84,10 +86,13 @@ namespace ft
 		 * name. If the value is true, the user is requested to choose a file name, otherwise 
 		 * (the default) the current file name is used. If the file has not yet been saved,
 		 * a file name is requested despite the value on this parameter.
-		 * @return Boolean indicating if the save was performed or false if the user cancelled
-		 * the operation.
+		 * @param bInBackground Boolean indicating if the file should be saved in a background
+		 * thread (true) or before the method returns (false, the default). In the first case,
+		 * the failure to save is only reported to the user when the thread finishes.
+		 * @return Boolean indicating if the save was performed (or started) or false if the user
+		 * cancelled the operation.
 		 */
-		bool saveCurrentFile(bool bAskForFileName=false);
+		bool saveCurrentFile(bool bAskForFileName=false, bool bInBackground=false);
 
 		/**
 		 * Gets the page index of the file if already opened in the editor.
@@ -109,6 +114,15 @@ namespace ft
 		 */
 		void keyPressEvent(QKeyEvent *pEvent) Q_DECL_OVERRIDE;
 
+		/**
+		 * Captures the resizing of the viewport of the view of thumbnails, in order to update
+		 * the range of images displayed on it.
+		 * @param pObject Instance of the QObject that received the event.
+		 * @param pEvent Instance of the QEvent with the parameters of the event that happened.
+		 * @return Boolean indicating if the event was filtered out (true) or not (false).
+		 */
+		bool eventFilter(QObject *pObject, QEvent *pEvent) Q_DECL_OVERRIDE;
+
 		/**
 		 * Creates a new child window instance.
 		 * @return Instance of the newly created ChildWindow.
@@ -143,6 +157,11 @@ namespace ft
 		 */ 
 		void on_actionOpen_triggered();
 
+		/**
+		 * Slot for the menu Open Lazily trigger event.
+		 */ 
+		void on_actionOpenLazily_triggered();
+
 		/**
 		 * Slot for the menu Save trigger event.
 		 */ 
@@ -277,6 +296,11 @@ namespace ft
 		 */
 		void on_actionDisconnectFeatures_triggered();
 
+		/**
+		 * Slot for the menu Compact Coordinates trigger event.
+		 */
+		void on_actionCompactCoordinates_triggered(bool bChecked);
+
 		/**
 		 * Define the view to be used for the list of images (icons, a list view, or "details", a tree view).
 		 * @param sType String with the type to be used (either "icons" or "details").
@@ -288,6 +312,12 @@ namespace ft
 		 */
 		void toggleImageListView();
 
+		/**
+		 * Updates the range of images displayed in the viewport of the view of thumbnails, so
+		 * the data model builds their thumbnails first and drops the ones scrolled out of view.
+		 */
+		void updateVisibleImages();
+
 		/**
 		 * Slot to capture indications of update in the UI due to changes in the child window selection model.
 		 * @param sImageName QString with the name of the current selected face image.
@@ -313,6 +343,13 @@ namespace ft
 		 */
 		void onUpdateUI();
 
+		/**
+		 * Captures the conclusion of a save done in background by a child window.
+		 * @param bSuccess Boolean indicating if the saving was successful or not.
+		 * @param sMsgError QString with the error message in case the saving failed.
+		 */
+		void onChildSaveFinished(const bool bSuccess, const QString sMsgError);
+
 		/**
 		 * Captures the result (error) of the process executed for the face-fit utility.
 		 * @param eError QProcess::ProcessError enumeration with the error type.
@@ -341,6 +378,9 @@ namespace ft
 		/** Instance of a dropdown button for the view mode of the image list. */
 		QMenu *m_pViewButton;
 
+		/** Permanent label in the status bar with the statistics of the image cache. */
+		QLabel *m_pImageCacheLabel;
+
 		/** Process instance to execute the face-fit utility. */
 		QProcess *m_oFitProcess;
 
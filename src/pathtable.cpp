@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "pathtable.h"
+
+#include <QReadWriteLock>
+#include <QAtomicInt>
+
+namespace
+{
+	/** Number of directories in each chunk of the shared table. */
+	const int CHUNK_SIZE = 4096;
+
+	/** Maximum number of chunks in the shared table. */
+	const int MAX_CHUNKS = 4096;
+
+	/**
+	 * Directories in the shared table (their identifiers are their indices), in chunks that
+	 * are never moved or changed once written. The table is only appended to, so the
+	 * directories already published (see g_iNumDirectories) are read without any lock.
+	 */
+	QString *g_apDirectories[MAX_CHUNKS];
+
+	/** Number of directories in the shared table (published after each directory is written). */
+	QAtomicInt g_iNumDirectories;
+
+	/** Identifiers of the directories in the shared table, indexed by their paths. */
+	QHash<QString, int> g_oDirectoryIDs;
+
+	/** Lock that protects the additions to the shared table. */
+	QReadWriteLock g_oLock;
+
+	/**
+	 * Splits the given file name at its last separator.
+	 * @param sFileName QString with the file name.
+	 * @param sDirectory QString to receive the directory part (empty if there is none).
+	 * @param sBaseName QString to receive the base name part.
+	 */
+	void splitPath(const QString &sFileName, QString &sDirectory, QString &sBaseName)
+	{
+		int iPos = sFileName.lastIndexOf('/');
+		if(iPos < 0)
+		{
+			sDirectory = QString();
+			sBaseName = sFileName;
+		}
+		else
+		{
+			// The separator is kept for the root directory
+			sDirectory = sFileName.left(iPos == 0 || sFileName.at(iPos - 1) == ':' ? iPos + 1 : iPos);
+			sBaseName = sFileName.mid(iPos + 1);
+		}
+	}
+}
+
+// +-----------------------------------------------------------
+ft::PathTable::PathTable(const QDir &oBase)
+{
+	m_oBase = oBase;
+}
+
+// +-----------------------------------------------------------
+void ft::PathTable::resolve(const QString &sFileName, int &iDirectory, QString &sBaseName)
+{
+	QString sDirectory;
+	splitPath(QDir::fromNativeSeparators(sFileName), sDirectory, sBaseName);
+
+	QHash<QString, int>::const_iterator it = m_oResolved.constFind(sDirectory);
+	if(it != m_oResolved.constEnd())
+	{
+		iDirectory = it.value();
+		return;
+	}
+
+	iDirectory = directoryID(QDir::cleanPath(m_oBase.absoluteFilePath(sDirectory)));
+	m_oResolved.insert(sDirectory, iDirectory);
+}
+
+// +-----------------------------------------------------------
+QString ft::PathTable::relativeFilePath(int iDirectory, const QString &sBaseName)
+{
+	QHash<int, QString>::const_iterator it = m_oRelative.constFind(iDirectory);
+	if(it == m_oRelative.constEnd())
+	{
+		QString sRelative = m_oBase.relativeFilePath(directory(iDirectory));
+		if(sRelative == ".")
+			sRelative.clear();
+		if(!sRelative.isEmpty() && !sRelative.endsWith('/'))
+			sRelative += '/';
+		it = m_oRelative.insert(iDirectory, sRelative);
+	}
+
+	return it.value() + sBaseName;
+}
+
+// +-----------------------------------------------------------
+void ft::PathTable::split(const QString &sFileName, int &iDirectory, QString &sBaseName)
+{
+	if(sFileName.isEmpty())
+	{
+		iDirectory = -1;
+		sBaseName = QString();
+		return;
+	}
+
+	QString sDirectory;
+	splitPath(QDir::cleanPath(QDir::fromNativeSeparators(sFileName)), sDirectory, sBaseName);
+	iDirectory = sDirectory.isEmpty() ? -1 : directoryID(sDirectory);
+}
+
+// +-----------------------------------------------------------
+QString ft::PathTable::filePath(int iDirectory, const QString &sBaseName)
+{
+	QString sDirectory = directory(iDirectory);
+	if(sDirectory.isEmpty())
+		return sBaseName;
+	if(sDirectory.endsWith('/'))
+		return sDirectory + sBaseName;
+	return sDirectory + '/' + sBaseName;
+}
+
+// +-----------------------------------------------------------
+int ft::PathTable::directoryID(const QString &sDirectory)
+{
+	{
+		QReadLocker oLocker(&g_oLock);
+		QHash<QString, int>::const_iterator it = g_oDirectoryIDs.constFind(sDirectory);
+		if(it != g_oDirectoryIDs.constEnd())
+			return it.value();
+	}
+
+	QWriteLocker oLocker(&g_oLock);
+	QHash<QString, int>::const_iterator it = g_oDirectoryIDs.constFind(sDirectory);
+	if(it != g_oDirectoryIDs.constEnd())
+		return it.value();
+
+	// The directory is written before it is published, so the readers never see it incomplete
+	int iDirectory = g_iNumDirectories.load();
+	Q_ASSERT(iDirectory < CHUNK_SIZE * MAX_CHUNKS);
+	QString *&pChunk = g_apDirectories[iDirectory / CHUNK_SIZE];
+	if(!pChunk)
+		pChunk = new QString[CHUNK_SIZE];
+	pChunk[iDirectory % CHUNK_SIZE] = sDirectory;
+	g_oDirectoryIDs.insert(sDirectory, iDirectory);
+	g_iNumDirectories.storeRelease(iDirectory + 1);
+	return iDirectory;
+}
+
+// +-----------------------------------------------------------
+QString ft::PathTable::directory(int iDirectory)
+{
+	// Called for every file name displayed, so it does not take the lock (see g_apDirectories)
+	if(iDirectory < 0 || iDirectory >= g_iNumDirectories.loadAcquire())
+		return QString();
+	return g_apDirectories[iDirectory / CHUNK_SIZE][iDirectory % CHUNK_SIZE];
+}
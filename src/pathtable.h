@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PATHTABLE_H
+#define PATHTABLE_H
+
+#include <QString>
+#include <QDir>
+#include <QHash>
+
+namespace ft
+{
+	/**
+	 * Table of the directories of the face image files. Many images are stored in the same
+	 * directories, so each (absolute) directory is stored only once, in a table shared by the
+	 * whole application, and the images only keep its identifier and their base file names.
+	 * The instances of the class resolve the file names relative to a base directory (the
+	 * directory of a dataset file): the conversion of each directory is computed only once
+	 * and reused for all the other files in it. The shared table can be used from any thread
+	 * (it is only appended to, so the directories are read without locking), but each
+	 * instance must be used by a single thread.
+	 */
+	class PathTable
+	{
+	public:
+		/**
+		 * Class constructor.
+		 * @param oBase QDir to which the file names are relative.
+		 */
+		PathTable(const QDir &oBase);
+
+		/**
+		 * Resolves a file name relative to the base directory into the identifier of its
+		 * (absolute) directory and its base file name.
+		 * @param sFileName QString with the file name (relative to the base directory or absolute).
+		 * @param iDirectory Integer to receive the identifier of the directory of the file.
+		 * @param sBaseName QString to receive the base name of the file.
+		 */
+		void resolve(const QString &sFileName, int &iDirectory, QString &sBaseName);
+
+		/**
+		 * Gets the file name relative to the base directory of the given file.
+		 * @param iDirectory Integer with the identifier of the directory of the file.
+		 * @param sBaseName QString with the base name of the file.
+		 * @return QString with the relative file name.
+		 */
+		QString relativeFilePath(int iDirectory, const QString &sBaseName);
+
+		/**
+		 * Splits the given absolute file name into the identifier of its directory and its
+		 * base file name (the directory is added to the shared table if needed).
+		 * @param sFileName QString with the absolute file name.
+		 * @param iDirectory Integer to receive the identifier of the directory of the file
+		 * (or -1 if the file name is empty).
+		 * @param sBaseName QString to receive the base name of the file.
+		 */
+		static void split(const QString &sFileName, int &iDirectory, QString &sBaseName);
+
+		/**
+		 * Gets the complete file name of the given file.
+		 * @param iDirectory Integer with the identifier of the directory of the file.
+		 * @param sBaseName QString with the base name of the file.
+		 * @return QString with the absolute file name (or the base name alone if the
+		 * identifier of the directory is invalid).
+		 */
+		static QString filePath(int iDirectory, const QString &sBaseName);
+
+		/**
+		 * Gets the identifier of the given directory, adding it to the shared table if needed.
+		 * @param sDirectory QString with the absolute (and clean) path of the directory.
+		 * @return Integer with the identifier of the directory.
+		 */
+		static int directoryID(const QString &sDirectory);
+
+		/**
+		 * Gets the path of the directory with the given identifier.
+		 * @param iDirectory Integer with the identifier of the directory.
+		 * @return QString with the absolute path of the directory, or an empty string if the
+		 * identifier is invalid.
+		 */
+		static QString directory(int iDirectory);
+
+	private:
+
+		/** Directory to which the file names are relative. */
+		QDir m_oBase;
+
+		/** Identifiers of the directories already resolved, indexed by their relative paths. */
+		QHash<QString, int> m_oResolved;
+
+		/** Relative paths (with the trailing separator) of the directories already converted. */
+		QHash<int, QString> m_oRelative;
+	};
+}
+
+#endif // PATHTABLE_H
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "thumbnailcache.h"
+
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDir>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+
+namespace
+{
+	/**
+	 * Version of the thumbnails, part of their identification (so the thumbnails built in
+	 * a different way by older versions of the application are not reused).
+	 */
+	const int THUMBNAIL_VERSION = 2;
+}
+
+// +-----------------------------------------------------------
+bool ft::ThumbnailCache::find(const QString &sFileName, int iSize, QImage &oThumbnail)
+{
+	QString sThumbnailFile = thumbnailFile(sFileName, iSize);
+	if(sThumbnailFile.isEmpty())
+		return false;
+
+	// A missing or damaged thumbnail file is just a miss
+	QImage oImage;
+	if(!oImage.load(sThumbnailFile, "PNG"))
+		return false;
+
+	oThumbnail = oImage;
+	return true;
+}
+
+// +-----------------------------------------------------------
+bool ft::ThumbnailCache::store(const QString &sFileName, int iSize, const QImage &oThumbnail)
+{
+	QString sThumbnailFile = thumbnailFile(sFileName, iSize);
+	if(sThumbnailFile.isEmpty() || !QDir().mkpath(QFileInfo(sThumbnailFile).absolutePath()))
+		return false;
+
+	// The file is only replaced when completely written, so other threads (or instances of
+	// the application) never read a partial thumbnail
+	QSaveFile oFile(sThumbnailFile);
+	if(!oFile.open(QFile::WriteOnly))
+		return false;
+	if(!oThumbnail.save(&oFile, "PNG"))
+	{
+		oFile.cancelWriting();
+		return false;
+	}
+	return oFile.commit();
+}
+
+// +-----------------------------------------------------------
+QString ft::ThumbnailCache::directory()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails";
+}
+
+// +-----------------------------------------------------------
+QString ft::ThumbnailCache::thumbnailFile(const QString &sFileName, int iSize)
+{
+	QFileInfo oInfo(sFileName);
+	if(!oInfo.exists())
+		return QString();
+
+	QString sKey = QString("%1\n%2\n%3\n%4\n%5").arg(oInfo.absoluteFilePath(), QString::number(oInfo.size()), QString::number(oInfo.lastModified().toMSecsSinceEpoch()), QString::number(iSize), QString::number(THUMBNAIL_VERSION));
+	QString sHash = QString::fromLatin1(QCryptographicHash::hash(sKey.toUtf8(), QCryptographicHash::Sha1).toHex());
+
+	// The files are spread in subdirectories, so no directory gets too large
+	return QString("%1/%2/%3.png").arg(directory(), sHash.left(2), sHash);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2016 Luiz Carlos Vieira (http://www.luiz.vieira.nom.br)
+ *
+ * This file is part of FLAT.
+ *
+ * FLAT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FLAT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QString>
+#include <QImage>
+
+namespace ft
+{
+	/**
+	 * Cache of the thumbnails of the face images in the disk, shared by all datasets (and by
+	 * the different executions of the application), so the images do not have to be decoded
+	 * again to build their thumbnails. The thumbnails are identified by the absolute file names
+	 * of the images, their sizes and times of last modification (so a file changed on disk
+	 * has its thumbnail built again), and by the size of the thumbnails. They are stored as
+	 * small PNG files in the cache directory of the application. The cache can be used from
+	 * any thread.
+	 */
+	class ThumbnailCache
+	{
+	public:
+		/**
+		 * Reads the thumbnail of the given image from the cache.
+		 * @param sFileName QString with the complete file name of the image.
+		 * @param iSize Integer with the width and height of the thumbnail.
+		 * @param oThumbnail QImage to receive the thumbnail.
+		 * @return Boolean indicating if the thumbnail was found (true) or not (false).
+		 */
+		static bool find(const QString &sFileName, int iSize, QImage &oThumbnail);
+
+		/**
+		 * Writes the thumbnail of the given image to the cache.
+		 * @param sFileName QString with the complete file name of the image.
+		 * @param iSize Integer with the width and height of the thumbnail.
+		 * @param oThumbnail QImage with the thumbnail.
+		 * @return Boolean indicating if the thumbnail was written (true) or not (false).
+		 */
+		static bool store(const QString &sFileName, int iSize, const QImage &oThumbnail);
+
+		/**
+		 * Gets the directory in which the thumbnails are stored.
+		 * @return QString with the absolute path of the directory.
+		 */
+		static QString directory();
+
+	protected:
+
+		/**
+		 * Gets the file in which the thumbnail of the given image is stored.
+		 * @param sFileName QString with the complete file name of the image.
+		 * @param iSize Integer with the width and height of the thumbnail.
+		 * @return QString with the absolute path of the thumbnail file, or an empty string
+		 * if the image file does not exist.
+		 */
+		static QString thumbnailFile(const QString &sFileName, int iSize);
+	};
+}
+
+#endif // THUMBNAILCACHE_H